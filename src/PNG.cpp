@@ -1,4 +1,5 @@
 #include <iostream>
+#include <utility>
 #include "lodepng/lodepng.h"
 #include "PNG.h"
 
@@ -10,7 +11,7 @@ PNG::PNG()
 
 PNG::PNG(const char * filename)
 {
-    lodepng::decode(rawdata, width, height, filename);
+    read(filename);
 }
 
 PNG::PNG(unsigned int width, unsigned int height)
@@ -20,24 +21,76 @@ PNG::PNG(unsigned int width, unsigned int height)
     this->height = height;
 }
 
-PNG::PNG(PNG & other)
+PNG::PNG(const PNG & other)
 {
     this->rawdata = other.rawdata;
     this->width = other.width;
     this->height = other.height;
 }
 
-unsigned PNG::getWidth()
+/*
+    Takes over the pixels of other without copying them, leaving other empty.
+*/
+PNG::PNG(PNG && other) noexcept
+{
+    this->rawdata = std::move(other.rawdata);
+    this->width = other.width;
+    this->height = other.height;
+    other.rawdata.clear();
+    other.width = 0;
+    other.height = 0;
+}
+
+PNG & PNG::operator=(const PNG & other)
+{
+    this->rawdata = other.rawdata;
+    this->width = other.width;
+    this->height = other.height;
+    return *this;
+}
+
+/*
+    Takes over the pixels of other without copying them, leaving other empty.
+*/
+PNG & PNG::operator=(PNG && other) noexcept
+{
+    if (this == &other) return *this;
+    this->rawdata = std::move(other.rawdata);
+    this->width = other.width;
+    this->height = other.height;
+    other.rawdata.clear();
+    other.width = 0;
+    other.height = 0;
+    return *this;
+}
+
+/*
+    Makes this a white width x height image, reusing the pixel buffer if it
+    is big enough.
+*/
+void PNG::reset(unsigned int width, unsigned int height)
+{
+    rawdata.assign(width * height * 4, 255);
+    this->width = width;
+    this->height = height;
+}
+
+unsigned PNG::getWidth() const
 {
     return width;
 }
 
-unsigned PNG::getHeight()
+unsigned PNG::getHeight() const
 {
     return height;
 }
 
-Pixel PNG::getPixel(unsigned int x, unsigned int y)
+const unsigned char * PNG::getRawData() const
+{
+    return rawdata.data();
+}
+
+Pixel PNG::getPixel(unsigned int x, unsigned int y) const
 {
     if (x < 0 || x >= width || y < 0 || y >= height)
     {
@@ -66,7 +119,30 @@ bool PNG::setPixel(unsigned int x, unsigned int y, Pixel p)
     return true;
 }
 
-bool PNG::write(const char * filename)
+/*
+    Replaces the image with the one in a png file. On failure the image is
+    left empty.
+
+    @param filename The file to read
+    @return Whether the file could be read
+*/
+bool PNG::read(const char * filename)
+{
+    // lodepng appends to the vector it decodes into
+    rawdata.clear();
+    unsigned error = lodepng::decode(rawdata, width, height, filename);
+    if (error)
+    {
+        cout << __FUNCTION__ << ": ERROR " << lodepng_error_text(error) << endl;
+        rawdata.clear();
+        width = 0;
+        height = 0;
+        return false;
+    }
+    return true;
+}
+
+bool PNG::write(const char * filename) const
 {
     unsigned error = lodepng::encode(filename, rawdata, width, height);
     if (error)
@@ -76,3 +152,44 @@ bool PNG::write(const char * filename)
     }
     return true;
 }
+
+/*
+    Replaces the image with one decoded from png data in memory. On failure
+    the image is left empty.
+
+    @param data The png data
+    @param size The number of bytes of data
+    @return Whether the data could be decoded
+*/
+bool PNG::read(const unsigned char * data, size_t size)
+{
+    rawdata.clear();
+    unsigned error = lodepng::decode(rawdata, width, height, data, size);
+    if (error)
+    {
+        cout << __FUNCTION__ << ": ERROR " << lodepng_error_text(error) << endl;
+        rawdata.clear();
+        width = 0;
+        height = 0;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Encodes the image as png data in memory.
+
+    @param out Set to the png data
+    @return Whether the image could be encoded
+*/
+bool PNG::write(vector<unsigned char> & out) const
+{
+    out.clear();
+    unsigned error = lodepng::encode(out, rawdata, width, height);
+    if (error)
+    {
+        cout << __FUNCTION__ << ": ERROR " << lodepng_error_text(error) << endl;
+        return false;
+    }
+    return true;
+}
@@ -20,15 +20,28 @@ public:
 
     PNG(unsigned int width, unsigned int height);
 
-    PNG(PNG & other);
+    PNG(const PNG & other);
 
-    unsigned getWidth();
-    unsigned getHeight();
+    PNG(PNG && other) noexcept;
 
-    Pixel getPixel(unsigned int x, unsigned int y);
+    PNG & operator=(const PNG & other);
+
+    PNG & operator=(PNG && other) noexcept;
+
+    void reset(unsigned int width, unsigned int height);
+
+    unsigned getWidth() const;
+    unsigned getHeight() const;
+
+    const unsigned char * getRawData() const;
+
+    Pixel getPixel(unsigned int x, unsigned int y) const;
     bool setPixel(unsigned int x, unsigned int y, Pixel p);
 
-    bool write(const char * filename);
+    bool read(const char * filename);
+    bool read(const unsigned char * data, size_t size);
+    bool write(const char * filename) const;
+    bool write(vector<unsigned char> & out) const;
 
 
 };
@@ -0,0 +1,594 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lodepng/lodepng.h"
+#include "batch.h"
+#include "boundedqueue.h"
+
+/*
+    Reads a comma separated list of outputs.
+
+    @param list The list
+    @param emit Set to the combination of batchOutputs in the list
+    @return Whether every name in the list is known
+*/
+bool parseEmit (const string & list, int & emit)
+{
+    emit = 0;
+    istringstream names(list);
+    string name;
+    while (getline(names, name, ','))
+    {
+        if (name == "recreated") emit |= EMIT_RECREATED;
+        else if (name == "ridge") emit |= EMIT_RIDGE;
+        else if (name == "distance") emit |= EMIT_DISTANCE;
+        else return false;
+    }
+    return emit != 0;
+}
+
+/*
+    Returns the path of the outputs of an input in directory, named after the
+    input without its extension.
+
+    @param directory The output directory
+    @param input The input file
+*/
+string outputFor (const string & directory, const string & input)
+{
+    return (filesystem::path(directory) / filesystem::path(input).stem()).string();
+}
+
+/*
+    Adds a job for every png file in a directory, in name order.
+
+    @param jobs The jobs to add to
+    @param directory The directory of the inputs
+    @param output The output directory
+    @return Whether the directory could be read
+*/
+bool addDirectory (vector<BatchJob> & jobs, const string & directory,
+                   const string & output)
+{
+    error_code error;
+    vector<string> inputs;
+    for (const filesystem::directory_entry & entry : filesystem::directory_iterator(directory, error))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".png")
+            inputs.push_back(entry.path().string());
+    }
+    if (error) return false;
+
+    sort(inputs.begin(), inputs.end());
+    for (const string & input : inputs)
+    {
+        BatchJob job;
+        job.input = input;
+        job.output = outputFor(output, input);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+/*
+    Adds the jobs listed in a manifest, one 'input [output]' pair per line.
+    Blank lines and lines starting with # are skipped. A .png extension on an
+    output is dropped, as the outputs are named by adding to it.
+
+    @param jobs The jobs to add to
+    @param manifest The manifest file
+    @param output The output directory, for inputs without an output
+    @return Whether the manifest could be read
+*/
+bool addManifest (vector<BatchJob> & jobs, const string & manifest,
+                  const string & output)
+{
+    ifstream in(manifest);
+    if (!in) return false;
+
+    string line;
+    while (getline(in, line))
+    {
+        istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.input) || job.input[0] == '#') continue;
+        if (fields >> job.output)
+        {
+            filesystem::path path(job.output);
+            if (path.extension() == ".png") job.output = path.replace_extension().string();
+        }
+        else
+        {
+            job.output = outputFor(output, job.input);
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+/*
+    Reads a whole number of at least min.
+
+    @param text The number
+    @param min The smallest value allowed
+    @param value Set to the number
+    @return Whether text is such a number
+*/
+bool parseCount (const char * text, int min, int & value)
+{
+    char * end;
+    long number = strtol(text, &end, 10);
+    if (end == text || *end || number < min || number > INT_MAX) return false;
+    value = number;
+    return true;
+}
+
+/*
+    Returns a view of the outputs of a skeleton, or of the ones taken out of
+    it. Outputs that are not wanted are passed as NULL.
+
+    @param recreated The recreated image
+    @param ridge_list The ridge points
+    @param distance_map The distance map
+*/
+SkeletonOutputs outputsOf (const PNG * recreated,
+                           const vector<RidgePoint> * ridge_list,
+                           const DistanceMap * distance_map)
+{
+    SkeletonOutputs outputs;
+    if (recreated)
+    {
+        outputs.width = recreated->getWidth();
+        outputs.height = recreated->getHeight();
+        outputs.recreated = recreated->getRawData();
+    }
+    if (ridge_list)
+    {
+        outputs.ridge_list = ridge_list->data();
+        outputs.ridge_count = ridge_list->size();
+    }
+    if (distance_map)
+    {
+        outputs.width = distance_map->getWidth();
+        outputs.height = distance_map->getHeight();
+        outputs.distance = distance_map->rowData(0);
+        outputs.distance_bytes = distance_map->getCellBytes();
+        outputs.distance_stride = distance_map->getStride();
+    }
+    return outputs;
+}
+
+/*
+    Returns a view of the outputs in a cache file, which has all of them.
+
+    @param cached The mapped cache file
+*/
+SkeletonOutputs outputsOf (const CachedSkeleton & cached)
+{
+    SkeletonOutputs outputs;
+    outputs.width = cached.getWidth();
+    outputs.height = cached.getHeight();
+    outputs.recreated = cached.getRecreatedData();
+    outputs.ridge_list = cached.getRidgePointList();
+    outputs.ridge_count = cached.getRidgePointCount();
+    outputs.distance = cached.getDistanceCells();
+    outputs.distance_bytes = cached.getDistanceBytes();
+    outputs.distance_stride = cached.getWidth();
+    return outputs;
+}
+
+/*
+    Returns the distance value of a point.
+
+    @param outputs The outputs with the distance map
+    @param x The column of the point
+    @param y The row of the point
+*/
+static int distanceAt (const SkeletonOutputs & outputs, int x, int y)
+{
+    size_t i = (size_t)y * outputs.distance_stride + x;
+    if (outputs.distance_bytes == 1) return ((const uint8_t *)outputs.distance)[i];
+    if (outputs.distance_bytes == 2) return ((const uint16_t *)outputs.distance)[i];
+    return ((const uint32_t *)outputs.distance)[i];
+}
+
+/*
+    Prints the distance values of each point, skipping the background points.
+
+    @param out The stream to print to
+    @param outputs The outputs with the distance map to be printed.
+ */
+void printDistanceMap (ostream & out, const SkeletonOutputs & outputs)
+{
+    for (int y = 0; y < outputs.height; y++)
+    {
+        for (int x = 0; x < outputs.width; x++)
+        {
+            int distance = distanceAt(outputs, x, y);
+            if (distance) out << distance;
+            else out << " ";
+            out  << ((distance / 100) ? " "  :
+                     (distance /  10) ? "  " :
+                                        "   ");
+        }
+        out << '\n';
+    }
+}
+
+/*
+    Prints the number of ridge points, then the x, y and distance value of
+    each one on its own line, in raster order.
+
+    @param out The stream to print to
+    @param outputs The outputs with the ridge points to be printed
+*/
+void printRidgePoints (ostream & out, const SkeletonOutputs & outputs)
+{
+    out << outputs.ridge_count << '\n';
+    for (size_t i = 0; i < outputs.ridge_count; i++)
+    {
+        const RidgePoint & p = outputs.ridge_list[i];
+        out << p.x << ' ' << p.y << ' ' << p.distance << '\n';
+    }
+}
+
+/*
+    Encodes the recreated image as png data.
+
+    @param outputs The outputs with the recreated image
+    @param png Set to the png data
+    @return Whether the image could be encoded
+*/
+bool encodeRecreated (const SkeletonOutputs & outputs, vector<unsigned char> & png)
+{
+    png.clear();
+    unsigned error = lodepng::encode(png, outputs.recreated, outputs.width,
+                                     outputs.height);
+    if (error)
+    {
+        cout << __FUNCTION__ << ": ERROR " << lodepng_error_text(error) << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Reads the image of a job, recording in the job why that failed if it did.
+
+    @param job The job to read the image of
+    @param img Set to the image
+    @return Whether there is an image to skeletonize
+*/
+bool readJob (BatchJob & job, PNG & img)
+{
+    if (!img.read(job.input.c_str()))
+    {
+        job.error = "could not read the image";
+        return false;
+    }
+    if (img.getWidth() == 0 || img.getHeight() == 0)
+    {
+        job.error = "the image is empty";
+        return false;
+    }
+    return true;
+}
+
+/*
+    Returns the options a skeleton of the batch is made with.
+
+    @param options The settings of the batch
+    @param workspace The buffers to calculate in
+*/
+SkeletonOptions skeletonOptions (const BatchOptions & options,
+                                 SkeletonWorkspace & workspace)
+{
+    SkeletonOptions skeleton_options;
+    skeleton_options.distance_metric = options.distance_metric;
+    skeleton_options.threads = options.transform_threads;
+    skeleton_options.workspace = &workspace;
+    return skeleton_options;
+}
+
+/*
+    Looks the outputs of a skeleton up in the cache of the batch. If they are
+    not there, they are calculated and stored first, so that they are
+    served from the same place either way.
+
+    @param skeleton The skeleton, with nothing but its mask calculated when
+                    the outputs are in the cache
+    @param options The settings of the batch
+    @param skeleton_options The settings the skeleton was made with
+    @return the mapped outputs, or NULL if there is no cache or they could
+            not be stored in it
+*/
+shared_ptr<CachedSkeleton> cachedOutputs (Skeleton & skeleton,
+                                          const BatchOptions & options,
+                                          const SkeletonOptions & skeleton_options)
+{
+    if (!options.cache) return NULL;
+    shared_ptr<CachedSkeleton> cached = options.cache->find(skeleton.getMask(),
+                                                            skeleton_options);
+    if (cached) return cached;
+    if (!options.cache->store(skeleton, skeleton_options)) return NULL;
+    return options.cache->find(skeleton.getMask(), skeleton_options);
+}
+
+/*
+    Opens an output file for writing, making it if it does not exist and
+    emptying it if it does. This is how a batch opens its outputs.
+
+    @param path The file
+    @return the descriptor of the file, or -1
+*/
+int openOutput (const string & path)
+{
+    return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+/*
+    Writes data to an output file.
+
+    @param open How the file is opened
+    @param path The file
+    @param data The data
+    @param size The size of the data
+    @return Whether all of it was written
+*/
+static bool writeOutput (const OutputOpener & open, const string & path,
+                         const void * data, size_t size)
+{
+    int fd = open(path);
+    if (fd < 0)
+    {
+        cout << __FUNCTION__ << ": ERROR could not open " << path << ": "
+             << strerror(errno) << endl;
+        return false;
+    }
+    const char * bytes = (const char *)data;
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = write(fd, bytes + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        done += n;
+    }
+    bool ok = done == size;
+    ok = (close(fd) == 0) && ok;
+    if (!ok) cout << __FUNCTION__ << ": ERROR could not write " << path << endl;
+    return ok;
+}
+
+/*
+    Writes the outputs of a job and records in the job whether that worked.
+    The outputs are named by adding to job.output: .png for the recreated
+    image, _ridge.txt and _distance.txt for the text ones.
+
+    @param job The job to write the outputs of
+    @param emit The outputs to write, a combination of batchOutputs
+    @param outputs The outputs, of which the ones in emit must be there
+    @param open How the output files are opened
+*/
+void writeJob (BatchJob & job, int emit, const SkeletonOutputs & outputs,
+               const OutputOpener & open)
+{
+    job.ok = true;
+    if (emit & EMIT_RECREATED)
+    {
+        vector<unsigned char> png;
+        if (!encodeRecreated(outputs, png) ||
+            !writeOutput(open, job.output + ".png", png.data(), png.size()))
+        {
+            job.ok = false;
+            job.error = "could not write the recreated image";
+        }
+    }
+    if (job.ok && (emit & EMIT_RIDGE))
+    {
+        ostringstream out;
+        printRidgePoints(out, outputs);
+        string text = out.str();
+        if (!writeOutput(open, job.output + "_ridge.txt", text.data(), text.size()))
+        {
+            job.ok = false;
+            job.error = "could not write the ridge points";
+        }
+    }
+    if (job.ok && (emit & EMIT_DISTANCE))
+    {
+        ostringstream out;
+        printDistanceMap(out, outputs);
+        string text = out.str();
+        if (!writeOutput(open, job.output + "_distance.txt", text.data(), text.size()))
+        {
+            job.ok = false;
+            job.error = "could not write the distance map";
+        }
+    }
+}
+
+/*
+    Reads, skeletonizes and writes the image of one job, calculating in
+    workspace, and records in the job whether that worked.
+
+    @param job The job to run
+    @param options The settings of the batch
+    @param workspace The buffers to calculate in
+*/
+void runJob (BatchJob & job, const BatchOptions & options,
+             SkeletonWorkspace & workspace)
+{
+    PNG img;
+    if (!readJob(job, img)) return;
+
+    SkeletonOptions skeleton_options = skeletonOptions(options, workspace);
+    Skeleton skeleton(std::move(img), skeleton_options);
+    shared_ptr<CachedSkeleton> cached = cachedOutputs(skeleton, options,
+                                                      skeleton_options);
+    int emit = options.emit;
+    if (cached)
+    {
+        writeJob(job, emit, outputsOf(*cached));
+    }
+    else
+    {
+        writeJob(job, emit,
+                 outputsOf((emit & EMIT_RECREATED) ? &skeleton.getRecreatedImage() : NULL,
+                           (emit & EMIT_RIDGE) ? &skeleton.getRidgePointList() : NULL,
+                           (emit & EMIT_DISTANCE) ? &skeleton.getDistanceMap() : NULL));
+    }
+    skeleton.recycleInto(workspace);
+}
+
+/*
+    Runs every job on a pool of worker threads. Each worker has its own
+    workspace and takes the next job that nobody has started, so the images
+    are spread over the workers however long each one takes. Every image is
+    skeletonized on a single thread; the batch is what is parallel.
+
+    @param jobs The jobs to run
+    @param options The settings of the batch
+*/
+static void runPool (vector<BatchJob> & jobs, const BatchOptions & options)
+{
+    int threads = options.threads;
+    if (threads > (int)jobs.size()) threads = jobs.size();
+    if (threads < 1) threads = 1;
+
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        SkeletonWorkspace workspace;
+        for (size_t i = next++; i < jobs.size(); i = next++)
+        {
+            runJob(jobs[i], options, workspace);
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++)
+    {
+        workers.push_back(thread(work));
+    }
+    work();
+    for (thread & t : workers) t.join();
+}
+
+// an image on its way from the decode stage to the compute stage
+struct DecodedImage {
+    size_t job;
+    PNG img;
+};
+
+// the outputs of an image on their way from the compute stage to the
+// encode stage; the ones that are not written are left empty
+struct SkeletonResults {
+    size_t job;
+    shared_ptr<CachedSkeleton> cached; // all of the outputs, when cached
+    PNG recreated;
+    vector<RidgePoint> ridge_list;
+    DistanceMap distance_map;
+};
+
+/*
+    Runs every job in three stages, each on its own workers: decode reads the
+    images, compute skeletonizes them, and encode writes the outputs. The
+    stages pass the images on through bounded queues, so a fast stage waits
+    for a slow one instead of piling up images in memory; at most
+    queue_size images wait between two stages.
+
+    @param jobs The jobs to run
+    @param options The settings of the batch
+*/
+static void runPipeline (vector<BatchJob> & jobs, const BatchOptions & options)
+{
+    int decoders = max(options.decode_threads, 1);
+    int computers = max(options.threads, 1);
+    int encoders = max(options.encode_threads, 1);
+    BoundedQueue<DecodedImage> decoded(options.queue_size, decoders);
+    BoundedQueue<SkeletonResults> computed(options.queue_size, computers);
+
+    atomic<size_t> next(0);
+    auto decode = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++)
+        {
+            DecodedImage item;
+            item.job = i;
+            if (readJob(jobs[i], item.img)) decoded.push(std::move(item));
+        }
+        decoded.producerDone();
+    };
+
+    auto compute = [&]() {
+        SkeletonWorkspace workspace;
+        DecodedImage item;
+        while (decoded.pop(item))
+        {
+            SkeletonOptions skeleton_options = skeletonOptions(options, workspace);
+            Skeleton skeleton(std::move(item.img), skeleton_options);
+            SkeletonResults results;
+            results.job = item.job;
+            // with a cache, the encoders write from the cache file
+            results.cached = cachedOutputs(skeleton, options, skeleton_options);
+            if (!results.cached)
+            {
+                if (options.emit & EMIT_RECREATED)
+                    results.recreated = skeleton.takeRecreatedImage();
+                if (options.emit & EMIT_RIDGE)
+                    results.ridge_list = skeleton.takeRidgePointList();
+                if (options.emit & EMIT_DISTANCE)
+                    results.distance_map = skeleton.takeDistanceMap();
+            }
+            skeleton.recycleInto(workspace);
+            computed.push(std::move(results));
+        }
+        computed.producerDone();
+    };
+
+    auto encode = [&]() {
+        SkeletonResults results;
+        while (computed.pop(results))
+        {
+            int emit = options.emit;
+            if (results.cached)
+                writeJob(jobs[results.job], emit, outputsOf(*results.cached));
+            else
+                writeJob(jobs[results.job], emit,
+                         outputsOf((emit & EMIT_RECREATED) ? &results.recreated : NULL,
+                                   (emit & EMIT_RIDGE) ? &results.ridge_list : NULL,
+                                   (emit & EMIT_DISTANCE) ? &results.distance_map : NULL));
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < decoders; i++) workers.push_back(thread(decode));
+    for (int i = 0; i < computers; i++) workers.push_back(thread(compute));
+    for (int i = 0; i < encoders; i++) workers.push_back(thread(encode));
+    for (thread & t : workers) t.join();
+}
+
+/*
+    Runs every job of a batch, and records in each whether it worked. The
+    images go through the staged pipeline when the batch has decode or
+    encode workers of its own, and through a pool of workers that each do
+    all of an image otherwise.
+
+    @param jobs The jobs to run
+    @param options The settings of the batch
+*/
+void runBatch (vector<BatchJob> & jobs, const BatchOptions & options)
+{
+    if (options.decode_threads > 0 || options.encode_threads > 0)
+        runPipeline(jobs, options);
+    else
+        runPool(jobs, options);
+}
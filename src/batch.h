@@ -0,0 +1,103 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <ostream>
+#include <vector>
+#include <functional>
+#include "skeleton.h"
+#include "cache.h"
+
+using namespace std;
+
+// which results of a skeleton are written out
+enum batchOutput {
+    EMIT_RECREATED = 1, // the recreated image, as <output>.png
+    EMIT_RIDGE = 2,     // the ridge points, as <output>_ridge.txt
+    EMIT_DISTANCE = 4   // the distance map, as <output>_distance.txt
+};
+
+// settings shared by every image of a batch
+struct BatchOptions {
+    int threads = 1; // worker threads, each skeletonizing one image at a time
+    int transform_threads = 1; // threads each worker runs the distance
+                               // transforms of an image on
+    int emit = EMIT_RECREATED; // a combination of batchOutputs
+    metric distance_metric = MANHATTAN;
+    // workers that only read or only write images; with either above 0, the
+    // batch runs as a pipeline of decode, compute and encode stages
+    int decode_threads = 0;
+    int encode_threads = 0;
+    int queue_size = 8; // the most images waiting between two stages
+    ResultCache * cache = NULL; // where outputs are looked up before they
+                                // are calculated, and stored after, or NULL
+};
+
+// read-only pointers to the outputs of a skeleton, wherever they are kept;
+// the outputs that are not wanted may be NULL
+struct SkeletonOutputs {
+    int width = 0;
+    int height = 0;
+    const unsigned char * recreated = NULL; // RGBA pixels, row after row
+    const RidgePoint * ridge_list = NULL;
+    size_t ridge_count = 0;
+    const void * distance = NULL; // the cells of row 0 of the distance map
+    int distance_bytes = 0;       // the width of a cell
+    int distance_stride = 0;      // cells from one row to the next
+};
+
+// one image of a batch and what became of it
+struct BatchJob {
+    string input;
+    string output; // the path of the outputs, without the .png extension
+    bool ok = false;
+    string error; // why the image failed, when it did
+};
+
+// opens an output file for writing, returning its descriptor or -1
+typedef function<int (const string & path)> OutputOpener;
+
+bool parseEmit (const string & list, int & emit);
+
+bool parseCount (const char * text, int min, int & value);
+
+string outputFor (const string & directory, const string & input);
+
+bool addDirectory (vector<BatchJob> & jobs, const string & directory,
+                   const string & output);
+
+bool addManifest (vector<BatchJob> & jobs, const string & manifest,
+                  const string & output);
+
+SkeletonOutputs outputsOf (const PNG * recreated,
+                           const vector<RidgePoint> * ridge_list,
+                           const DistanceMap * distance_map);
+
+SkeletonOutputs outputsOf (const CachedSkeleton & cached);
+
+void printDistanceMap (ostream & out, const SkeletonOutputs & outputs);
+
+void printRidgePoints (ostream & out, const SkeletonOutputs & outputs);
+
+bool encodeRecreated (const SkeletonOutputs & outputs, vector<unsigned char> & png);
+
+bool readJob (BatchJob & job, PNG & img);
+
+SkeletonOptions skeletonOptions (const BatchOptions & options,
+                                 SkeletonWorkspace & workspace);
+
+shared_ptr<CachedSkeleton> cachedOutputs (Skeleton & skeleton,
+                                          const BatchOptions & options,
+                                          const SkeletonOptions & skeleton_options);
+
+int openOutput (const string & path);
+
+void writeJob (BatchJob & job, int emit, const SkeletonOutputs & outputs,
+               const OutputOpener & open = openOutput);
+
+void runJob (BatchJob & job, const BatchOptions & options,
+             SkeletonWorkspace & workspace);
+
+void runBatch (vector<BatchJob> & jobs, const BatchOptions & options);
+
+#endif
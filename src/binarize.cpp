@@ -0,0 +1,75 @@
+#include <cstdint>
+#include "binarize.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+    Scalar test for one pixel.
+*/
+static inline bool isBlack(const unsigned char * px, unsigned char eps)
+{
+    return px[0] <= eps && px[1] <= eps && px[2] <= eps &&
+           (unsigned char)(255 - px[3]) <= eps;
+}
+
+/*
+    Returns the foreground bits of up to 64 pixels starting at px, bit i being
+    pixel i. Pixels past count are left as 0.
+*/
+static uint64_t binarizeWord(const unsigned char * px, int count, unsigned char eps)
+{
+    uint64_t word = 0;
+    int i = 0;
+
+    // flipping the alpha byte turns a >= 255 - eps into ~a <= eps, so all four
+    // channels can be tested with one saturating subtract: the result is zero
+    // exactly when every channel is within eps
+#if defined(__AVX2__)
+    const __m256i flip = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i tol = _mm256_set1_epi8((char)eps);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(px + i * 4));
+        __m256i over = _mm256_subs_epu8(_mm256_xor_si256(v, flip), tol);
+        __m256i pass = _mm256_cmpeq_epi32(over, zero);
+        uint64_t bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(pass));
+        word |= bits << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i flip = _mm_set1_epi32((int)0xFF000000);
+    const __m128i tol = _mm_set1_epi8((char)eps);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(px + i * 4));
+        __m128i over = _mm_subs_epu8(_mm_xor_si128(v, flip), tol);
+        __m128i pass = _mm_cmpeq_epi32(over, zero);
+        uint64_t bits = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(pass));
+        word |= bits << i;
+    }
+#endif
+    for (; i < count; i++)
+    {
+        if (isBlack(px + i * 4, eps)) word |= (uint64_t)1 << i;
+    }
+    return word;
+}
+
+void binarizeRGBA(const unsigned char * rgba, int width, int height,
+                  unsigned char eps, BitMask & mask)
+{
+    const int W = BitMask::WORDBITS;
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char * src = rgba + (size_t)y * width * 4;
+        uint64_t * row = mask.row(y);
+        for (int i = 0; i < mask.getWordsPerRow(); i++)
+        {
+            int count = width - i * W < W ? width - i * W : W;
+            row[i] = binarizeWord(src + (size_t)i * W * 4, count, eps);
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef BINARIZE_H
+#define BINARIZE_H
+
+#include "bitmask.h"
+
+/*
+    Sets the bits of mask for every pixel of an RGBA buffer that is within eps
+    of opaque black in each channel, ie. r, g, b <= eps and a >= 255 - eps.
+    This is the same test as Pixel::approximate(Pixel(0, 0, 0, 255), eps),
+    done straight on the bytes with SSE2 or AVX2 when they are available.
+
+    @param rgba The pixel bytes, 4 per pixel, row-major with no padding
+    @param width The width of the image in pixels
+    @param height The height of the image in pixels
+    @param eps The per-channel tolerance
+    @param mask The mask to fill, must be width x height
+*/
+void binarizeRGBA(const unsigned char * rgba, int width, int height,
+                  unsigned char eps, BitMask & mask);
+
+#endif
@@ -0,0 +1,44 @@
+#include <algorithm>
+#include "bitmask.h"
+
+BitMask::BitMask()
+{
+    width = 0;
+    height = 0;
+    wordsPerRow = 0;
+}
+
+BitMask::BitMask(int width, int height)
+{
+    reset(width, height);
+}
+
+/*
+    Makes this a width x height mask with no pixels set. The buffer is
+    reused, so this only allocates if the mask grows past its largest size yet.
+
+    @param width The width of the mask
+    @param height The height of the mask
+*/
+void BitMask::reset(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    this->wordsPerRow = (width + WORDBITS - 1) / WORDBITS;
+    this->words.assign((size_t)wordsPerRow * height, 0);
+}
+
+/*
+    Checks whether row y has no pixels set, one word at a time.
+
+    @param y The row to check
+*/
+bool BitMask::isRowEmpty(int y) const
+{
+    const uint64_t * r = row(y);
+    for (int i = 0; i < wordsPerRow; i++)
+    {
+        if (r[i]) return false;
+    }
+    return true;
+}
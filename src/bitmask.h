@@ -0,0 +1,61 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+/*
+    A binary image packed one bit per pixel, 64 pixels to a word.
+    Bit (x % 64) of word (x / 64) in row y is the pixel at (x, y). Every row
+    starts on a new word, and the bits past the width are always 0, so whole
+    words can be tested and combined without masking.
+*/
+class BitMask {
+private:
+    int width;
+    int height;
+    int wordsPerRow;
+    vector<uint64_t> words;
+
+public:
+    static const int WORDBITS = 64;
+
+    BitMask();
+
+    BitMask(int width, int height);
+
+    void reset(int width, int height);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getWordsPerRow() const { return wordsPerRow; }
+    bool empty() const { return width == 0 || height == 0; }
+
+    /*
+        Returns a pointer to the first word of row y. No bounds checking is done.
+    */
+    uint64_t * row(int y) { return words.data() + (size_t)y * wordsPerRow; }
+    const uint64_t * row(int y) const { return words.data() + (size_t)y * wordsPerRow; }
+
+    /*
+        Returns whether the pixel at (x, y) is set. No bounds checking is done.
+    */
+    bool get(int x, int y) const
+    {
+        return (row(y)[x / WORDBITS] >> (x % WORDBITS)) & 1;
+    }
+
+    /*
+        Sets the pixel at (x, y) to 1. No bounds checking is done.
+    */
+    void set(int x, int y)
+    {
+        row(y)[x / WORDBITS] |= (uint64_t)1 << (x % WORDBITS);
+    }
+
+    bool isRowEmpty(int y) const;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/*
+    A first-in first-out queue between the threads of two pipeline stages,
+    holding at most capacity items. Producers wait while it is full, which
+    holds back a stage that gets ahead of the next one, and consumers wait
+    while it is empty. Once every producer has said it is done, consumers
+    get the items that are left and then nothing.
+*/
+template <typename T>
+class BoundedQueue {
+private:
+    mutex lock;
+    condition_variable notFull;
+    condition_variable notEmpty;
+    deque<T> items;
+    size_t capacity;
+    int producers;
+
+public:
+    /*
+        Constructor for an empty queue.
+
+        @param capacity The most items the queue holds, at least 1
+        @param producers The number of threads that will push to the queue
+    */
+    BoundedQueue (size_t capacity, int producers)
+    {
+        this->capacity = capacity < 1 ? 1 : capacity;
+        this->producers = producers;
+    }
+
+    /*
+        Adds an item to the back of the queue, waiting for room first.
+
+        @param item The item to add
+    */
+    void push (T && item)
+    {
+        unique_lock<mutex> guard(lock);
+        notFull.wait(guard, [&]() { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    /*
+        Takes the item at the front of the queue, waiting for one if the
+        queue is empty and some producer is not done.
+
+        @param item Set to the item taken
+        @return Whether there was an item; false once the queue is empty
+                and every producer is done
+    */
+    bool pop (T & item)
+    {
+        unique_lock<mutex> guard(lock);
+        notEmpty.wait(guard, [&]() { return !items.empty() || producers == 0; });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /*
+        Called by each producer once it will push nothing more.
+    */
+    void producerDone ()
+    {
+        lock_guard<mutex> guard(lock);
+        producers--;
+        if (producers == 0) notEmpty.notify_all();
+    }
+};
+
+#endif
@@ -0,0 +1,279 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+// bump when the file layout or the outputs of a skeleton change
+#define CACHEVERSION 1
+
+static const char CACHEMAGIC[8] = {'S', 'K', 'E', 'L', 'C', 'A', 'C', 'H'};
+
+/*
+    The start of every cache file. The sections it points to start on
+    8 byte boundaries: the mask as BitMask words, the distance map, the ridge
+    points and the RGBA pixels of the recreated image.
+*/
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t ridgePointSize; // sizeof(RidgePoint) where the file was written
+    int32_t width;
+    int32_t height;
+    int32_t metric;
+    int32_t stopWhenConnected;
+    int32_t distanceBytes;
+    int32_t segmentCount;
+    uint64_t ridgeCount;
+    uint64_t maskOffset;
+    uint64_t distanceOffset;
+    uint64_t ridgeOffset;
+    uint64_t recreatedOffset;
+    uint64_t fileSize;
+};
+
+/*
+    Returns offset rounded up to a multiple of 8.
+*/
+static uint64_t align8 (uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/*
+    Fills in where the sections of a file with the sizes in header go.
+
+    @param header The header to fill in, with the sizes set
+    @param wordsPerRow The words in each row of the mask
+*/
+static void layOut (CacheHeader & header, int wordsPerRow)
+{
+    uint64_t pixels = (uint64_t)header.width * header.height;
+    header.maskOffset = align8(sizeof(CacheHeader));
+    header.distanceOffset = align8(header.maskOffset +
+                                   (uint64_t)header.height * wordsPerRow * sizeof(uint64_t));
+    header.ridgeOffset = align8(header.distanceOffset + pixels * header.distanceBytes);
+    header.recreatedOffset = align8(header.ridgeOffset +
+                                    header.ridgeCount * header.ridgePointSize);
+    header.fileSize = header.recreatedOffset + pixels * 4;
+}
+
+/*
+    Mixes a word into a hash. This is not a strong hash; the cache checks
+    the mask of every hit, so collisions only cost a miss.
+
+    @param hash The hash so far
+    @param word The word to mix in
+    @return the new hash
+*/
+static uint64_t mix (uint64_t hash, uint64_t word)
+{
+    hash ^= word;
+    hash *= 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 32);
+}
+
+/*
+    Constructor for a mapped cache file. The header has been checked.
+
+    @param mapping The mapped file
+    @param size The size of the file
+*/
+CachedSkeleton::CachedSkeleton (const unsigned char * mapping, size_t size)
+{
+    const CacheHeader * header = (const CacheHeader *)mapping;
+    this->mapping = mapping;
+    this->size = size;
+    this->width = header->width;
+    this->height = header->height;
+    this->distanceBytes = header->distanceBytes;
+    this->segmentCount = header->segmentCount;
+    this->ridgeCount = header->ridgeCount;
+    this->distance = mapping + header->distanceOffset;
+    this->ridgeList = (const RidgePoint *)(mapping + header->ridgeOffset);
+    this->recreated = mapping + header->recreatedOffset;
+}
+
+CachedSkeleton::~CachedSkeleton ()
+{
+    munmap((void *)this->mapping, this->size);
+}
+
+/*
+    Constructor for a cache in directory, which is made if it does not exist.
+
+    @param directory The directory of the cache files
+*/
+ResultCache::ResultCache (const string & directory)
+{
+    this->directory = directory;
+    error_code error;
+    filesystem::create_directories(directory, error);
+}
+
+/*
+    Returns the path of the file for a key.
+*/
+string ResultCache::pathFor (uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.skel", (unsigned long long)key);
+    return (filesystem::path(this->directory) / name).string();
+}
+
+/*
+    Returns the key of the outputs of a mask under options: a hash of the
+    mask and of the options that change the outputs. The thread count and
+    the input policy do not, so they are left out.
+
+    @param mask The binary image
+    @param options The settings the skeleton is calculated with
+*/
+uint64_t ResultCache::key (const BitMask & mask, const SkeletonOptions & options)
+{
+    uint64_t hash = mix(CACHEVERSION, mask.getWidth());
+    hash = mix(hash, mask.getHeight());
+    hash = mix(hash, options.distance_metric);
+    hash = mix(hash, options.stop_when_connected);
+    for (int y = 0; y < mask.getHeight(); y++)
+    {
+        const uint64_t * row = mask.row(y);
+        for (int i = 0; i < mask.getWordsPerRow(); i++)
+        {
+            hash = mix(hash, row[i]);
+        }
+    }
+    return hash;
+}
+
+/*
+    Looks for the outputs of a mask under options in the cache.
+
+    @param mask The binary image
+    @param options The settings the skeleton is calculated with
+    @return the mapped outputs, or NULL if they are not in the cache
+*/
+shared_ptr<CachedSkeleton> ResultCache::find (const BitMask & mask,
+                                              const SkeletonOptions & options) const
+{
+    if (mask.empty()) return NULL;
+
+    int fd = open(pathFor(key(mask, options)).c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = info.st_size;
+    void * mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    // the file has to be for this mask and these options, and complete
+    const CacheHeader * header = (const CacheHeader *)mapping;
+    CacheHeader expected = *header;
+    layOut(expected, mask.getWordsPerRow());
+    bool match = memcmp(header->magic, CACHEMAGIC, sizeof(CACHEMAGIC)) == 0 &&
+                 header->version == CACHEVERSION &&
+                 header->ridgePointSize == sizeof(RidgePoint) &&
+                 header->width == mask.getWidth() &&
+                 header->height == mask.getHeight() &&
+                 header->metric == options.distance_metric &&
+                 header->stopWhenConnected == options.stop_when_connected &&
+                 (header->distanceBytes == 1 || header->distanceBytes == 2 ||
+                  header->distanceBytes == 4) &&
+                 memcmp(header, &expected, sizeof(CacheHeader)) == 0 &&
+                 header->fileSize == size;
+    const unsigned char * masks = (const unsigned char *)mapping + header->maskOffset;
+    size_t rowBytes = mask.getWordsPerRow() * sizeof(uint64_t);
+    for (int y = 0; match && y < mask.getHeight(); y++)
+    {
+        match = memcmp(masks + y * rowBytes, mask.row(y), rowBytes) == 0;
+    }
+    if (!match)
+    {
+        munmap(mapping, size);
+        return NULL;
+    }
+    return shared_ptr<CachedSkeleton>(
+        new CachedSkeleton((const unsigned char *)mapping, size));
+}
+
+/*
+    Calculates every output of a skeleton that is not calculated yet and
+    stores them in the cache.
+
+    @param skeleton The skeleton
+    @param options The settings the skeleton was made with
+    @return Whether the outputs could be stored
+*/
+bool ResultCache::store (Skeleton & skeleton, const SkeletonOptions & options) const
+{
+    const BitMask & mask = skeleton.getMask();
+    if (mask.empty()) return false;
+    const PNG & recreated = skeleton.getRecreatedImage();
+    const vector<RidgePoint> & ridge_list = skeleton.getRidgePointList();
+    const DistanceMap & distance_map = skeleton.getDistanceMap();
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHEMAGIC, sizeof(CACHEMAGIC));
+    header.version = CACHEVERSION;
+    header.ridgePointSize = sizeof(RidgePoint);
+    header.width = mask.getWidth();
+    header.height = mask.getHeight();
+    header.metric = options.distance_metric;
+    header.stopWhenConnected = options.stop_when_connected;
+    header.distanceBytes = distance_map.getCellBytes();
+    header.segmentCount = skeleton.getSegmentCount();
+    header.ridgeCount = ridge_list.size();
+    layOut(header, mask.getWordsPerRow());
+
+    string path = pathFor(key(mask, options));
+    string temporary = path + ".tmp" + to_string(getpid()) + "." +
+                       to_string(hash<thread::id>()(this_thread::get_id()));
+    FILE * file = fopen(temporary.c_str(), "wb");
+    if (!file)
+    {
+        cout << __FUNCTION__ << ": ERROR could not create " << temporary << endl;
+        return false;
+    }
+
+    // sections are written where the header says, leaving 0s in between
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fseek(file, header.maskOffset, SEEK_SET) == 0;
+    for (int y = 0; ok && y < header.height; y++)
+    {
+        ok = fwrite(mask.row(y), sizeof(uint64_t), mask.getWordsPerRow(), file) ==
+             (size_t)mask.getWordsPerRow();
+    }
+    ok = ok && fseek(file, header.distanceOffset, SEEK_SET) == 0;
+    for (int y = 0; ok && y < header.height; y++)
+    {
+        ok = fwrite(distance_map.rowData(y), header.distanceBytes, header.width, file) ==
+             (size_t)header.width;
+    }
+    ok = ok && fseek(file, header.ridgeOffset, SEEK_SET) == 0;
+    ok = ok && fwrite(ridge_list.data(), sizeof(RidgePoint), ridge_list.size(), file) ==
+               ridge_list.size();
+    ok = ok && fseek(file, header.recreatedOffset, SEEK_SET) == 0;
+    size_t bytes = (size_t)header.width * header.height * 4;
+    ok = ok && fwrite(recreated.getRawData(), 1, bytes, file) == bytes;
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        cout << __FUNCTION__ << ": ERROR could not write " << path << endl;
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "skeleton.h"
+
+using namespace std;
+
+/*
+    The outputs of a skeleton read back from a cache file, which is mapped
+    into memory rather than read, so nothing is copied or calculated until
+    the outputs are used. The pointers are valid as long as the object is.
+*/
+class CachedSkeleton {
+private:
+    const unsigned char * mapping;
+    size_t size;
+    int width;
+    int height;
+    int distanceBytes;
+    int segmentCount;
+    size_t ridgeCount;
+    const void * distance;
+    const RidgePoint * ridgeList;
+    const unsigned char * recreated;
+
+    CachedSkeleton (const unsigned char * mapping, size_t size);
+
+    friend class ResultCache;
+
+public:
+    ~CachedSkeleton ();
+
+    CachedSkeleton (const CachedSkeleton &) = delete;
+    CachedSkeleton & operator= (const CachedSkeleton &) = delete;
+
+    int getWidth () const { return width; }
+    int getHeight () const { return height; }
+
+    // the distance map, row after row with no border, in cells of
+    // getDistanceBytes() bytes
+    const void * getDistanceCells () const { return distance; }
+    int getDistanceBytes () const { return distanceBytes; }
+
+    // the ridge points, in raster order
+    const RidgePoint * getRidgePointList () const { return ridgeList; }
+    size_t getRidgePointCount () const { return ridgeCount; }
+
+    int getSegmentCount () const { return segmentCount; }
+
+    // the recreated image, as RGBA pixels row after row
+    const unsigned char * getRecreatedData () const { return recreated; }
+};
+
+/*
+    A directory of skeleton outputs, each in a file named after a hash of the
+    binary image it was calculated from and the options that change the
+    outputs. Since the outputs only depend on those, an image whose mask has
+    been skeletonized before with the same options can be served from the
+    cache without running any skeleton stage.
+
+    A hit is checked against the mask stored in the file, so a hash
+    collision is a miss and not a wrong result. Files are written under a
+    temporary name and renamed into place, so threads and processes can
+    share a directory. The files are in the layout of the machine that
+    wrote them and are not meant to be moved to another.
+*/
+class ResultCache {
+private:
+    string directory;
+
+    string pathFor (uint64_t key) const;
+
+public:
+    ResultCache (const string & directory);
+
+    static uint64_t key (const BitMask & mask, const SkeletonOptions & options);
+
+    shared_ptr<CachedSkeleton> find (const BitMask & mask,
+                                     const SkeletonOptions & options) const;
+
+    bool store (Skeleton & skeleton, const SkeletonOptions & options) const;
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "candidates.h"
+#include "simd.h"
+
+/*
+    The sign of a scan value, ie. the transition between neighbouring distance
+    values, packed in 2 bits. OUTSIDE stands for a scan value whose pixel is
+    off the map, which none of the patterns accept.
+*/
+enum scanSign {
+    ZERO = 0,
+    PLUS = 1,
+    MINUS = 2,
+    OUTSIDE = 3
+};
+
+// what the y scan line STRONG pass does to a pixel
+enum scanYAction {
+    KEEP,
+    MAKE_STRONG,
+    MAKE_STRONG_UNLESS_BELOW // +0- is only taken if the point below wasn't
+};
+
+/*
+    Code layout for the x scan line pass, 2 bits per sign:
+    scanX at x-1 | scanX at x | scanX at x+1 | scanY at y | scanY at y+1
+    and for the y scan line pass:
+    scanY at y-1 | scanY at y | scanY at y+1
+*/
+#define SCANX_LEFT 0
+#define SCANX_HERE 2
+#define SCANX_RIGHT 4
+#define SCANY_HERE 6
+#define SCANY_BELOW 8
+#define SCANX_CODES 1024
+
+#define SCANY_ABOVE 0
+#define SCANY_CENTER 2
+#define SCANY_UNDER 4
+#define SCANY_CODES 64
+
+static inline int sign (int v)
+{
+    return (v > 0) | ((v < 0) << 1);
+}
+
+static inline scanSign field (int code, int shift)
+{
+    return (scanSign)((code >> shift) & 3);
+}
+
+/*
+    The labels for every x scan line code, straight from the labelling rules:
+
+    STRONG: +- and +0- on the x scan line
+    GOOD: +0 or 0- on both scan lines
+    WEAK: +0 or 0- on one scan line
+    NONE: does not match any of the patterns above.
+*/
+static prominency scanXRule (int code)
+{
+    scanSign left = field(code, SCANX_LEFT);
+    scanSign here = field(code, SCANX_HERE);
+    scanSign right = field(code, SCANX_RIGHT);
+    scanSign y = field(code, SCANY_HERE);
+    scanSign below = field(code, SCANY_BELOW);
+
+    // +0-
+    if (left == PLUS && here == ZERO && right == MINUS) return STRONG;
+    // +-
+    if (here == PLUS && right == MINUS) return STRONG;
+
+    bool xPattern = (here == PLUS && right == ZERO) || (here == ZERO && right == MINUS);
+    bool yPattern = (y == PLUS && below == ZERO) || (y == ZERO && below == MINUS);
+    if (xPattern && yPattern) return GOOD;
+    if (xPattern || yPattern) return WEAK;
+    return NONE;
+}
+
+/*
+    The y scan line STRONG rules: +0- (unless the point below was chosen) and +-.
+*/
+static scanYAction scanYRule (int code)
+{
+    scanSign above = field(code, SCANY_ABOVE);
+    scanSign here = field(code, SCANY_CENTER);
+    scanSign below = field(code, SCANY_UNDER);
+
+    if (above == PLUS && here == ZERO && below == MINUS) return MAKE_STRONG_UNLESS_BELOW;
+    if (here == PLUS && below == MINUS) return MAKE_STRONG;
+    return KEEP;
+}
+
+struct LabelTables {
+    prominency scanX[SCANX_CODES];
+    scanYAction scanY[SCANY_CODES];
+
+    LabelTables ()
+    {
+        for (int code = 0; code < SCANX_CODES; code++) scanX[code] = scanXRule(code);
+        for (int code = 0; code < SCANY_CODES; code++) scanY[code] = scanYRule(code);
+    }
+};
+
+static const LabelTables tables;
+
+#if defined(SIMD)
+/*
+    sign() for every lane.
+*/
+static inline VEC vsign (VEC v)
+{
+    const VEC zero = VZERO();
+    return VOR(VAND(VCMPGT(v, zero), VSET1(PLUS)),
+               VAND(VCMPGT(zero, v), VSET1(MINUS)));
+}
+#endif
+
+/*
+    Works out the x scan line code of the pixel at x. Scan values of pixels
+    off the row (or of the row below the map) are OUTSIDE.
+*/
+static inline int scanXCode (const int * above, const int * row, const int * below,
+                             int width, int x)
+{
+    int left = x > 0 ? sign(row[x-1] - row[x-2]) : OUTSIDE;
+    int here = sign(row[x] - row[x-1]);
+    int right = x+1 < width ? sign(row[x+1] - row[x]) : OUTSIDE;
+    int y = sign(row[x] - above[x]);
+    int under = below ? sign(below[x] - row[x]) : OUTSIDE;
+    return (left << SCANX_LEFT) | (here << SCANX_HERE) | (right << SCANX_RIGHT) |
+           (y << SCANY_HERE) | (under << SCANY_BELOW);
+}
+
+/*
+    Labels the ridge candidates of a row that come from the x scan line
+    (STRONG), and the GOOD and WEAK labels from both scan lines.
+    The rows are read two cells past either end, and the row above is read
+    even at the top of the map, so they must come from a distance map with a
+    border of at least 2 that is all 0.
+
+    @param above The distance map row above
+    @param row The distance map row to label
+    @param below The distance map row below, or NULL
+    @param width The length of the rows
+    @param labels The labels of the row, every one is written
+*/
+void labelScanXRow (const int * above, const int * row, const int * below,
+                    int width, prominency * labels)
+{
+    int x = 0;
+    // the first pixel has no scan value on its left
+    for (; x < width && x < 1; x++)
+    {
+        labels[x] = tables.scanX[scanXCode(above, row, below, width, x)];
+    }
+#if defined(SIMD)
+    const VEC underOutside = VSET1(OUTSIDE << SCANY_BELOW);
+    int codes[LANES];
+    for (; x + LANES < width; x += LANES)
+    {
+        VEC left2 = VLOAD(row + x - 2);
+        VEC left = VLOAD(row + x - 1);
+        VEC here = VLOAD(row + x);
+        VEC right = VLOAD(row + x + 1);
+        VEC up = VLOAD(above + x);
+
+        VEC code = vsign(VSUB(left, left2));
+        code = VOR(code, VSHIFTL(vsign(VSUB(here, left)), SCANX_HERE));
+        code = VOR(code, VSHIFTL(vsign(VSUB(right, here)), SCANX_RIGHT));
+        code = VOR(code, VSHIFTL(vsign(VSUB(here, up)), SCANY_HERE));
+        if (below)
+            code = VOR(code, VSHIFTL(vsign(VSUB(VLOAD(below + x), here)), SCANY_BELOW));
+        else
+            code = VOR(code, underOutside);
+
+        VSTORE(codes, code);
+        for (int i = 0; i < LANES; i++)
+        {
+            labels[x+i] = tables.scanX[codes[i]];
+        }
+    }
+#endif
+    for (; x < width; x++)
+    {
+        labels[x] = tables.scanX[scanXCode(above, row, below, width, x)];
+    }
+}
+
+/*
+    Labels the STRONG ridge candidates of a row that come from the y scan line.
+    This must run after labelScanXRow has labelled this row and the row below,
+    so that +0- ties go to the point the x scan line already chose.
+    Like labelScanXRow, the rows above are read even at the top of the map.
+
+    @param above2 The distance map row two above
+    @param above The distance map row above
+    @param row The distance map row to label
+    @param below The distance map row below, or NULL
+    @param width The length of the rows
+    @param labels The labels of the row
+    @param belowLabels The labels of the row below, or NULL
+*/
+void labelScanYRow (const int * above2, const int * above, const int * row,
+                    const int * below, int width, prominency * labels,
+                    const prominency * belowLabels)
+{
+    int x = 0;
+#if defined(SIMD)
+    const VEC underOutside = VSET1(OUTSIDE << SCANY_UNDER);
+    int codes[LANES];
+    for (; x + LANES <= width; x += LANES)
+    {
+        VEC here = VLOAD(row + x);
+        VEC up = VLOAD(above + x);
+        VEC code = vsign(VSUB(up, VLOAD(above2 + x)));
+        code = VOR(code, VSHIFTL(vsign(VSUB(here, up)), SCANY_CENTER));
+        if (below)
+            code = VOR(code, VSHIFTL(vsign(VSUB(VLOAD(below + x), here)), SCANY_UNDER));
+        else
+            code = VOR(code, underOutside);
+
+        VSTORE(codes, code);
+        for (int i = 0; i < LANES; i++)
+        {
+            scanYAction action = tables.scanY[codes[i]];
+            if (action == MAKE_STRONG ||
+                (action == MAKE_STRONG_UNLESS_BELOW && belowLabels[x+i] != STRONG))
+            {
+                labels[x+i] = STRONG;
+            }
+        }
+    }
+#endif
+    for (; x < width; x++)
+    {
+        int up = sign(above[x] - above2[x]);
+        int here = sign(row[x] - above[x]);
+        int under = below ? sign(below[x] - row[x]) : OUTSIDE;
+        int code = (up << SCANY_ABOVE) | (here << SCANY_CENTER) | (under << SCANY_UNDER);
+
+        scanYAction action = tables.scanY[code];
+        if (action == MAKE_STRONG ||
+            (action == MAKE_STRONG_UNLESS_BELOW && belowLabels[x] != STRONG))
+        {
+            labels[x] = STRONG;
+        }
+    }
+}
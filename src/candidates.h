@@ -0,0 +1,29 @@
+#ifndef CANDIDATES_H
+#define CANDIDATES_H
+
+// labels for the candidate ridge points
+enum prominency {
+    NONE,
+    WEAK,
+    GOOD,
+    STRONG
+};
+
+/*
+    Row kernels for labelling ridge candidates from the sign patterns of the
+    distance map. Each takes pointers to the distance map rows it looks at,
+    and classifies every pixel of the row by packing the signs of its scan
+    values into a small code and looking the label up in a table built from
+    the labelling rules. The rows must have a zero border two cells wide (see
+    Grid), so that nothing is bounds checked; only the row below the map is
+    passed as NULL, as its scan values are OUTSIDE rather than 0.
+*/
+
+void labelScanXRow (const int * above, const int * row, const int * below,
+                    int width, prominency * labels);
+
+void labelScanYRow (const int * above2, const int * above, const int * row,
+                    const int * below, int width, prominency * labels,
+                    const prominency * belowLabels);
+
+#endif
@@ -0,0 +1,73 @@
+#include "disjointset.h"
+
+DisjointSet::DisjointSet()
+{
+    sets = 0;
+}
+
+/*
+    Adds a new element in a set of its own.
+
+    @return The number of the new element
+*/
+int DisjointSet::add()
+{
+    int i = parent.size();
+    parent.push_back(i);
+    size.push_back(1);
+    sets++;
+    return i;
+}
+
+/*
+    Returns the representative of the set containing element i.
+    Halves the path to the root on the way.
+
+    @param i The element
+*/
+int DisjointSet::find(int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/*
+    Merges the sets containing elements a and b, the smaller into the larger.
+
+    @param a The first element
+    @param b The second element
+    @return Whether they were in different sets
+*/
+bool DisjointSet::unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b) return false;
+    if (size[a] < size[b]) swap(a, b);
+    parent[b] = a;
+    size[a] += size[b];
+    sets--;
+    return true;
+}
+
+/*
+    Returns the number of disjoint sets.
+*/
+int DisjointSet::count() const
+{
+    return sets;
+}
+
+/*
+    Removes every element.
+*/
+void DisjointSet::clear()
+{
+    parent.clear();
+    size.clear();
+    sets = 0;
+}
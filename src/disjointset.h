@@ -0,0 +1,32 @@
+#ifndef DISJOINTSET_H
+#define DISJOINTSET_H
+
+#include <vector>
+
+using namespace std;
+
+/*
+    Union-find over elements numbered 0, 1, 2, ... in the order they are added.
+    Keeps track of how many disjoint sets there are.
+*/
+class DisjointSet {
+private:
+    vector<int> parent;
+    vector<int> size;
+    int sets;
+
+public:
+    DisjointSet();
+
+    int add();
+
+    int find(int i);
+
+    bool unite(int a, int b);
+
+    int count() const;
+
+    void clear();
+};
+
+#endif
@@ -0,0 +1,523 @@
+#include <climits>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "distance.h"
+#include "parallel.h"
+#include "simd.h"
+
+// larger than any distance, small enough that adding the width can't overflow
+#define FARAWAY (INT_MAX / 2)
+
+/*
+    Returns the 8 mask bits starting at column x of a mask row, bit i being
+    the pixel at x + i. Bits past the end of the row are 0.
+*/
+static inline unsigned maskByte (const uint64_t * row, int words, int x)
+{
+    int i = x / BitMask::WORDBITS;
+    int b = x % BitMask::WORDBITS;
+    uint64_t bits = row[i] >> b;
+    if (b > BitMask::WORDBITS - 8 && i + 1 < words)
+        bits |= row[i+1] << (BitMask::WORDBITS - b);
+    return bits & 0xFF;
+}
+
+#if defined(__AVX2__)
+
+/*
+    Expands 8 mask bits into 8 lanes of all ones (set) or all zeros (unset).
+*/
+static inline __m256i expandBits (unsigned bits)
+{
+    const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i b = _mm256_set1_epi32(bits);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(b, select), select);
+}
+
+/*
+    Lane i of the result is the minimum of lanes 0..i of v.
+*/
+static inline __m256i prefixMin (__m256i v)
+{
+    const __m256i far = _mm256_set1_epi32(FARAWAY);
+    v = _mm256_min_epi32(v, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v,
+            _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)), far, 0x01));
+    v = _mm256_min_epi32(v, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v,
+            _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5)), far, 0x03));
+    v = _mm256_min_epi32(v, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v,
+            _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 3)), far, 0x0F));
+    return v;
+}
+
+/*
+    Lane i of the result is the minimum of lanes i..7 of v.
+*/
+static inline __m256i suffixMin (__m256i v)
+{
+    const __m256i far = _mm256_set1_epi32(FARAWAY);
+    v = _mm256_min_epi32(v, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v,
+            _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 7)), far, 0x80));
+    v = _mm256_min_epi32(v, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v,
+            _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 7, 7)), far, 0xC0));
+    v = _mm256_min_epi32(v, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v,
+            _mm256_setr_epi32(4, 5, 6, 7, 7, 7, 7, 7)), far, 0xF0));
+    return v;
+}
+
+#elif defined(__SSE2__)
+
+static inline __m128i expandBits (unsigned bits)
+{
+    const __m128i select = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i b = _mm_set1_epi32(bits);
+    return _mm_cmpeq_epi32(_mm_and_si128(b, select), select);
+}
+
+// byte shifts bring in zeros, which are then replaced by FARAWAY
+static inline __m128i prefixMin (__m128i v)
+{
+    v = min32(v, _mm_or_si128(_mm_slli_si128(v, 4), _mm_setr_epi32(FARAWAY, 0, 0, 0)));
+    v = min32(v, _mm_or_si128(_mm_slli_si128(v, 8), _mm_setr_epi32(FARAWAY, FARAWAY, 0, 0)));
+    return v;
+}
+
+static inline __m128i suffixMin (__m128i v)
+{
+    v = min32(v, _mm_or_si128(_mm_srli_si128(v, 4), _mm_setr_epi32(0, 0, 0, FARAWAY)));
+    v = min32(v, _mm_or_si128(_mm_srli_si128(v, 8), _mm_setr_epi32(0, 0, FARAWAY, FARAWAY)));
+    return v;
+}
+
+#endif
+
+/*
+    Copies n cells into ints, so that the kernels can work in 32-bit lanes
+    whatever the grid stores.
+*/
+template <typename T>
+static inline void widen (const T * cells, int * values, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        values[i] = cells[i];
+    }
+}
+
+/*
+    Copies n ints back into cells. The values must fit.
+*/
+template <typename T>
+static inline void narrow (const int * values, T * cells, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        cells[i] = (T)values[i];
+    }
+}
+
+/*
+    Copies n ints into cells, clamping them to the largest value a cell holds.
+*/
+template <typename T>
+static inline void narrowSaturated (const int * values, T * cells, int n)
+{
+    const long long top = numeric_limits<T>::max();
+    for (int i = 0; i < n; i++)
+    {
+        cells[i] = (T)min((long long)values[i], top);
+    }
+}
+
+/*
+    Column phase for the columns [x0, x1): sets dist to the distance from each
+    pixel to the nearest unset pixel in the same column.
+
+    Going down, a set pixel is one further than the pixel above it; going up,
+    it keeps the smaller of that and one further than the pixel below it.
+    Whole rows are processed at once, LANES columns at a time. The running
+    distances of the last row are kept as ints in a buffer the width of the
+    strip, so the grid is only written going down and read and written once
+    going up.
+
+    The counts going down can reach the height of the image, more than the
+    cells may hold, as the cells are only wide enough for the final
+    distances. They are stored clamped to the largest cell value, and going
+    up only lowers them, so the vertical distances are clamped the same way.
+    That loses nothing: a clamped vertical distance is still at least as
+    large as every final distance, so the row phase, which only ever takes
+    smaller values, never picks it over the true distance.
+*/
+template <typename T>
+void manhattanColumns (const BitMask & mask, Grid<T> & dist, int x0, int x1,
+                       DistanceBuffers & buffers)
+{
+    int height = mask.getHeight();
+    int words = mask.getWordsPerRow();
+    // the rows above and below the image are 0
+    vector<int> & run = buffers.run;
+    run.assign(x1 - x0, 0);
+
+    for (int y = 0; y < height; y++)
+    {
+        const uint64_t * bits = mask.row(y);
+        T * curr = dist[y];
+        int x = x0;
+#if defined(SIMD)
+        const VEC one = VSET1(1);
+        for (; x + LANES <= x1; x += LANES)
+        {
+            int * above = run.data() + (x - x0);
+            VEC set = expandBits(maskByte(bits, words, x));
+            VSTORE(above, VAND(VADD(VLOAD(above), one), set));
+            narrowSaturated(above, curr + x, LANES);
+        }
+#endif
+        for (; x < x1; x++)
+        {
+            int & above = run[x - x0];
+            above = mask.get(x, y) ? above + 1 : 0;
+            narrowSaturated(&above, curr + x, 1);
+        }
+    }
+
+    std::fill(run.begin(), run.end(), 0);
+    for (int y = height-1; y >= 0; y--)
+    {
+        T * curr = dist[y];
+        int x = x0;
+#if defined(SIMD)
+        const VEC one = VSET1(1);
+        int here[LANES];
+        for (; x + LANES <= x1; x += LANES)
+        {
+            int * below = run.data() + (x - x0);
+            widen(curr + x, here, LANES);
+            VSTORE(below, VMIN(VLOAD(here), VADD(VLOAD(below), one)));
+            narrow(below, curr + x, LANES);
+        }
+#endif
+        for (; x < x1; x++)
+        {
+            int & below = run[x - x0];
+            below = min((int)curr[x], below + 1);
+            curr[x] = (T)below;
+        }
+    }
+}
+
+/*
+    Row phase for a single row of vertical distances d, in place.
+
+    Going right, d[x] = min(d[x], d[x-1] + 1), which unrolls to
+    d[x] = x + min over k <= x of (d[k] - k), a prefix minimum that is done
+    across the SIMD lanes with only the last lane carried between blocks.
+    Going left is the mirror image with a suffix minimum.
+*/
+static void manhattanLine (int * d, int width)
+{
+    // left to right, the pixel left of the image is 0
+    int carry = 0;
+    int x = 0;
+#if defined(SIMD)
+    const VEC lane = VLANE_INDEX();
+    for (; x + LANES <= width; x += LANES)
+    {
+        VEC pm = prefixMin(VSUB(VLOAD(d + x), lane));
+        VEC v = VADD(VMIN(pm, VSET1(carry + 1)), lane);
+        VSTORE(d + x, v);
+        carry = VLAST(v);
+    }
+#endif
+    for (; x < width; x++)
+    {
+        d[x] = min(d[x], carry + 1);
+        carry = d[x];
+    }
+
+    // right to left, the pixel right of the image is 0
+    carry = 0;
+    x = width;
+#if defined(SIMD)
+    int tail = width % LANES;
+#else
+    int tail = width;
+#endif
+    for (int i = 0; i < tail; i++)
+    {
+        x--;
+        d[x] = min(d[x], carry + 1);
+        carry = d[x];
+    }
+#if defined(SIMD)
+    for (x -= LANES; x >= 0; x -= LANES)
+    {
+        VEC sm = suffixMin(VADD(VLOAD(d + x), lane));
+        VEC v = VSUB(VMIN(sm, VSET1(carry + LANES)), lane);
+        VSTORE(d + x, v);
+        carry = VFIRST(v);
+    }
+#endif
+}
+
+/*
+    Row phase for the rows [y0, y1): turns the vertical distances from
+    manhattanColumns into Manhattan distances, one row at a time through
+    an int buffer.
+*/
+template <typename T>
+void manhattanRows (const BitMask & mask, Grid<T> & dist, int y0, int y1,
+                    DistanceBuffers & buffers)
+{
+    int width = dist.getWidth();
+    vector<int> & line = buffers.run;
+    line.resize(width);
+
+    for (int y = y0; y < y1; y++)
+    {
+        // rows with no set pixels are all 0 already
+        if (mask.isRowEmpty(y)) continue;
+        widen(dist[y], line.data(), width);
+        manhattanLine(line.data(), width);
+        narrow(line.data(), dist[y], width);
+    }
+}
+
+/*
+    Computes the Manhattan distance transform of mask into dist.
+    dist must be the same size as mask.
+
+    The column phase is split into vertical strips of whole mask words and the
+    row phase into horizontal bands, one per thread. Columns and rows only
+    depend on themselves within a phase, so the result is the same for any
+    number of threads.
+
+    @param mask The binary image
+    @param dist The grid to hold the distance values
+    @param scratch The buffers to calculate in
+    @param threads The number of threads to use
+*/
+template <typename T>
+void manhattanDistance (const BitMask & mask, Grid<T> & dist,
+                        DistanceScratch & scratch, int threads)
+{
+    DistanceBuffers * buffers = scratch.forThreads(max(threads, 1));
+    parallelRanges(0, mask.getWidth(), threads, BitMask::WORDBITS, [&](int i, int x0, int x1) {
+        manhattanColumns(mask, dist, x0, x1, buffers[i]);
+    });
+    parallelRanges(0, mask.getHeight(), threads, 1, [&](int i, int y0, int y1) {
+        manhattanRows(mask, dist, y0, y1, buffers[i]);
+    });
+}
+
+/*
+    The largest distance manhattanDistance finds in a width x height mask: no
+    pixel is more than half the width or half the height from a side of the
+    image. The column phase clamps its larger values to the cells.
+*/
+long long manhattanDistanceBound (int width, int height)
+{
+    return (min(width, height) + 1) / 2;
+}
+
+// stands in for "no parabola here" in the lower envelope; big enough to lose
+// to any real value, small enough that sums of it don't overflow
+#define NOSITE (1LL << 50)
+
+/*
+    Floor division for a positive divisor.
+*/
+static inline long long floorDiv (long long num, long long den)
+{
+    return num >= 0 ? num / den : -((-num + den - 1) / den);
+}
+
+/*
+    Lower envelope of parabolas in one dimension (Meijster et al.):
+    out[u] = min over i of ((u - i)^2 + f[i]), for u and i in [0, n).
+
+    @param f The height of the parabola rooted at each point, NOSITE if none
+    @param n The number of points
+    @param out The envelope values
+    @param s Scratch space for n parabola roots
+    @param t Scratch space for n segment starts
+*/
+static void lowerEnvelope (const long long * f, int n, long long * out,
+                           int * s, int * t)
+{
+    int q = 0;
+    s[0] = 0;
+    t[0] = 0;
+    for (int u = 1; u < n; u++)
+    {
+        // drop the parabolas that u beats from the start of their segment on
+        while (q >= 0 &&
+               (long long)(t[q] - s[q]) * (t[q] - s[q]) + f[s[q]] >
+               (long long)(t[q] - u) * (t[q] - u) + f[u])
+        {
+            q--;
+        }
+        if (q < 0)
+        {
+            q = 0;
+            s[0] = u;
+        }
+        else
+        {
+            // first point where u's parabola is below s[q]'s
+            long long w = 1 + floorDiv((long long)u * u - (long long)s[q] * s[q] + f[u] - f[s[q]],
+                                       2LL * (u - s[q]));
+            if (w < n)
+            {
+                q++;
+                s[q] = u;
+                t[q] = w;
+            }
+        }
+    }
+    for (int u = n-1; u >= 0; u--)
+    {
+        out[u] = (long long)(u - s[q]) * (u - s[q]) + f[s[q]];
+        if (u == t[q]) q--;
+    }
+}
+
+/*
+    Computes the squared Euclidean distance transform of mask into dist.
+    dist must be the same size as mask.
+
+    The column phase is the same as for the Manhattan transform (the vertical
+    distance to the background); the row phase then takes the lower envelope
+    of the parabolas (x - i)^2 + g(i)^2 along each row. Both phases are
+    split over threads, by columns and then by rows.
+
+    @param mask The binary image
+    @param dist The grid to hold the squared distance values
+    @param scratch The buffers to calculate in
+    @param threads The number of threads to use
+*/
+template <typename T>
+void euclideanDistance (const BitMask & mask, Grid<T> & dist,
+                        DistanceScratch & scratch, int threads)
+{
+    int width = mask.getWidth();
+    int height = mask.getHeight();
+    DistanceBuffers * buffers = scratch.forThreads(max(threads, 1));
+
+    parallelRanges(0, width, threads, BitMask::WORDBITS, [&](int i, int x0, int x1) {
+        manhattanColumns(mask, dist, x0, x1, buffers[i]);
+    });
+
+    parallelRanges(0, height, threads, 1, [&](int i, int y0, int y1) {
+        vector<long long> & f = buffers[i].f;
+        vector<long long> & out = buffers[i].out;
+        vector<int> & s = buffers[i].s;
+        vector<int> & t = buffers[i].t;
+        f.resize(width); out.resize(width);
+        s.resize(width); t.resize(width);
+        for (int y = y0; y < y1; y++)
+        {
+            if (mask.isRowEmpty(y)) continue;
+            T * d = dist[y];
+            for (int x = 0; x < width; x++)
+            {
+                f[x] = (long long)d[x] * d[x];
+            }
+            lowerEnvelope(f.data(), width, out.data(), s.data(), t.data());
+            for (int x = 0; x < width; x++)
+            {
+                // the columns either side of the image are background too
+                long long edge = min(x + 1, width - x);
+                d[x] = (T)min(out[x], edge * edge);
+            }
+        }
+    });
+}
+
+/*
+    The largest squared distance euclideanDistance finds in a width x height
+    mask: the square of the largest distance to the nearest side of the
+    image. The column phase clamps its larger values to the cells.
+*/
+long long euclideanDistanceBound (int width, int height)
+{
+    long long side = (min(width, height) + 1) / 2;
+    return side * side;
+}
+
+/*
+    Marks every pixel that lies strictly inside the disc of some ridge point,
+    the disc's squared radius being the ridge point's squared distance value.
+    This is the reverse of euclideanDistance: the column phase takes the lower
+    envelope of (y - j)^2 - dist(x, j) over ridge points j in each column, the
+    row phase combines those along rows, and a pixel is covered where the
+    result is negative.
+
+    @param dist The squared distance map
+    @param ridge_points The grid with the ridge points as non-zero values
+    @param covered The mask to set the covered pixels in, cleared beforehand
+    @param scratch The buffers to calculate in
+    @param threads The number of threads to use
+*/
+template <typename T>
+void euclideanCoverage (const Grid<T> & dist, const Grid<int> & ridge_points,
+                        BitMask & covered, DistanceScratch & scratch, int threads)
+{
+    int width = dist.getWidth();
+    int height = dist.getHeight();
+    DistanceBuffers * buffers = scratch.forThreads(max(threads, 1));
+    Grid<long long> & columns = scratch.columns;
+    columns.reset(width, height, NOSITE);
+
+    parallelRanges(0, width, threads, 1, [&](int i, int x0, int x1) {
+        vector<long long> & f = buffers[i].f;
+        vector<long long> & out = buffers[i].out;
+        vector<int> & s = buffers[i].s;
+        vector<int> & t = buffers[i].t;
+        f.resize(height); out.resize(height);
+        s.resize(height); t.resize(height);
+        for (int x = x0; x < x1; x++)
+        {
+            bool any = false;
+            for (int y = 0; y < height; y++)
+            {
+                f[y] = ridge_points[y][x] ? -(long long)dist[y][x] : NOSITE;
+                any = any || ridge_points[y][x];
+            }
+            if (!any) continue;
+            lowerEnvelope(f.data(), height, out.data(), s.data(), t.data());
+            for (int y = 0; y < height; y++)
+            {
+                columns[y][x] = out[y];
+            }
+        }
+    });
+
+    parallelRanges(0, height, threads, 1, [&](int i, int y0, int y1) {
+        vector<long long> & out = buffers[i].out;
+        vector<int> & s = buffers[i].s;
+        vector<int> & t = buffers[i].t;
+        out.resize(width); s.resize(width); t.resize(width);
+        for (int y = y0; y < y1; y++)
+        {
+            lowerEnvelope(columns[y], width, out.data(), s.data(), t.data());
+            for (int x = 0; x < width; x++)
+            {
+                if (out[x] < 0) covered.set(x, y);
+            }
+        }
+    });
+}
+
+#define INSTANTIATE(T) \
+    template void manhattanColumns (const BitMask &, Grid<T> &, int, int, DistanceBuffers &); \
+    template void manhattanRows (const BitMask &, Grid<T> &, int, int, DistanceBuffers &); \
+    template void manhattanDistance (const BitMask &, Grid<T> &, DistanceScratch &, int); \
+    template void euclideanDistance (const BitMask &, Grid<T> &, DistanceScratch &, int); \
+    template void euclideanCoverage (const Grid<T> &, const Grid<int> &, BitMask &, \
+                                     DistanceScratch &, int);
+
+INSTANTIATE(uint8_t)
+INSTANTIATE(uint16_t)
+INSTANTIATE(uint32_t)
@@ -0,0 +1,89 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <vector>
+#include "grid.h"
+#include "bitmask.h"
+
+using namespace std;
+
+// the buffers one thread of a transform works in
+struct DistanceBuffers {
+    vector<int> run;       // running distances of a column strip, or a row
+    vector<long long> f;   // heights of the parabolas of a lower envelope
+    vector<long long> out; // the lower envelope
+    vector<int> s;         // roots of the parabolas in the envelope
+    vector<int> t;         // where their segments start
+};
+
+/*
+    Scratch space for the transforms: a set of buffers for each thread, and
+    the column envelopes of euclideanCoverage. Every buffer grows to the
+    largest mask seen and is then reused, so repeated calls with the same
+    scratch for masks of the same size do not allocate. The buffers are
+    freed with the scratch. Only one transform may use a scratch at a time.
+*/
+struct DistanceScratch {
+    vector<DistanceBuffers> threads;
+    Grid<long long> columns;
+
+    // the buffers for the given number of threads, one set each
+    DistanceBuffers * forThreads (int count)
+    {
+        if ((int)threads.size() < count) threads.resize(count);
+        return threads.data();
+    }
+};
+
+/*
+    Manhattan distance transform of a binary mask.
+
+    Every set pixel gets the city-block distance to the nearest unset pixel,
+    counting everything outside the image as unset; unset pixels get 0.
+    The transform is done in two separable phases: a column phase that finds
+    the vertical distance to the background, and a row phase that combines
+    those along each row. Each phase is split into the range functions below
+    so that callers can hand disjoint column or row ranges to different threads.
+
+    The transforms are instantiated for grids of uint8_t, uint16_t and
+    uint32_t. The arithmetic is done in ints either way; the grid only has to
+    be wide enough for the values, which the bound functions give for a mask
+    of a given size (see DistanceMap).
+
+    The callers own the scratch buffers (see DistanceScratch), so they decide
+    how long the buffers live.
+*/
+
+template <typename T>
+void manhattanColumns (const BitMask & mask, Grid<T> & dist, int x0, int x1,
+                       DistanceBuffers & buffers);
+
+template <typename T>
+void manhattanRows (const BitMask & mask, Grid<T> & dist, int y0, int y1,
+                    DistanceBuffers & buffers);
+
+template <typename T>
+void manhattanDistance (const BitMask & mask, Grid<T> & dist,
+                        DistanceScratch & scratch, int threads = 1);
+
+long long manhattanDistanceBound (int width, int height);
+
+/*
+    Exact Euclidean distance transform of a binary mask, using the separable
+    lower-envelope algorithm of Meijster et al. Every set pixel gets the
+    squared Euclidean distance to the nearest unset pixel (outside the image
+    counts as unset). Squared distances are integers and order the same way
+    as the distances, which is all the ridge labelling looks at.
+*/
+
+template <typename T>
+void euclideanDistance (const BitMask & mask, Grid<T> & dist,
+                        DistanceScratch & scratch, int threads);
+
+long long euclideanDistanceBound (int width, int height);
+
+template <typename T>
+void euclideanCoverage (const Grid<T> & dist, const Grid<int> & ridge_points,
+                        BitMask & covered, DistanceScratch & scratch, int threads);
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef DISTANCEMAP_H
+#define DISTANCEMAP_H
+
+#include <cstdint>
+#include "grid.h"
+
+using namespace std;
+
+/*
+    A distance map stored in the narrowest unsigned cells that can hold its
+    values: 8, 16 or 32 bits, picked when the map is created from the largest
+    value it will have to hold. Distances are bounded by the size of the
+    image, so the maps of small and medium images take a half or a quarter of
+    the memory (and memory traffic) of a map of ints.
+
+    Cells read as ints with map[y][x], which switches on the cell width for
+    every access. Loops over the whole map should use visit() instead, which
+    hands the underlying Grid<uint8_t>, Grid<uint16_t> or Grid<uint32_t> to a
+    generic function, so that the loop is compiled once for each cell type.
+*/
+class DistanceMap {
+private:
+    int cellBytes;
+    Grid<uint8_t> cells8;
+    Grid<uint16_t> cells16;
+    Grid<uint32_t> cells32;
+
+public:
+    /*
+        Read-only access to one row of the map.
+    */
+    class Row {
+    private:
+        const void * cells;
+        int cellBytes;
+
+    public:
+        Row (const void * cells, int cellBytes)
+        {
+            this->cells = cells;
+            this->cellBytes = cellBytes;
+        }
+
+        int operator[] (int x) const
+        {
+            if (cellBytes == 1) return ((const uint8_t *)cells)[x];
+            if (cellBytes == 2) return ((const uint16_t *)cells)[x];
+            return ((const uint32_t *)cells)[x];
+        }
+    };
+
+    /*
+        Default constructor for an empty map.
+    */
+    DistanceMap ()
+    {
+        cellBytes = 0;
+    }
+
+    /*
+        Constructor for a width x height map of 0s.
+
+        @param width The number of columns
+        @param height The number of rows
+        @param maxValue The largest value the map will hold
+        @param border The number of sentinel cells on each side (see Grid)
+    */
+    DistanceMap (int width, int height, long long maxValue, int border = 0)
+    {
+        reset(width, height, maxValue, border);
+    }
+
+    /*
+        Makes this a width x height map of 0s, as the constructor does.
+        The grid for each cell width is reused (see Grid::reset), so a map
+        that is reset for images of the same size does not allocate.
+
+        @param width The number of columns
+        @param height The number of rows
+        @param maxValue The largest value the map will hold
+        @param border The number of sentinel cells on each side (see Grid)
+    */
+    void reset (int width, int height, long long maxValue, int border = 0)
+    {
+        if (maxValue <= UINT8_MAX)
+        {
+            cellBytes = 1;
+            cells8.reset(width, height, 0, border);
+        }
+        else if (maxValue <= UINT16_MAX)
+        {
+            cellBytes = 2;
+            cells16.reset(width, height, 0, border);
+        }
+        else
+        {
+            cellBytes = 4;
+            cells32.reset(width, height, 0, border);
+        }
+    }
+
+    /*
+        Calls f with the grid that holds the cells, and returns what it
+        returns. An empty map passes an empty Grid<uint32_t>.
+
+        @param f A function that can take a Grid<T> & for any cell type T
+    */
+    template <typename F>
+    auto visit (F f)
+    {
+        if (cellBytes == 1) return f(cells8);
+        if (cellBytes == 2) return f(cells16);
+        return f(cells32);
+    }
+
+    template <typename F>
+    auto visit (F f) const
+    {
+        if (cellBytes == 1) return f(cells8);
+        if (cellBytes == 2) return f(cells16);
+        return f(cells32);
+    }
+
+    int getWidth () const { return visit([](auto & g) { return g.getWidth(); }); }
+    int getHeight () const { return visit([](auto & g) { return g.getHeight(); }); }
+    int getCellBytes () const { return cellBytes; }
+    int getStride () const { return visit([](auto & g) { return g.getStride(); }); }
+
+    /*
+        Returns the cells of row y, which are getCellBytes() wide each and
+        getStride() cells from those of the next row. No bounds checking is
+        done.
+
+        @param y The row
+    */
+    const void * rowData (int y) const
+    {
+        return visit([y](auto & g) { return (const void *)g[y]; });
+    }
+    bool empty () const { return cellBytes == 0 || getWidth() == 0 || getHeight() == 0; }
+
+    /*
+        Returns row y for reading cells with map[y][x]. No bounds checking
+        is done.
+
+        @param y The row
+    */
+    Row operator[] (int y) const
+    {
+        if (cellBytes == 1) return Row(cells8[y], 1);
+        if (cellBytes == 2) return Row(cells16[y], 2);
+        return Row(cells32[y], 4);
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+using namespace std;
+
+/*
+    A 2d grid of values stored row-major in a single contiguous buffer.
+    Rows are stride elements apart, so grid[y][x] is one multiply and one add
+    away from the start of the buffer instead of a pointer chase per row.
+
+    A grid can be given a border of sentinel cells around it. Cells in the
+    border can be read and written with coordinates from -border to
+    width-1+border (height-1+border for rows), so loops that look at
+    neighbours need no bounds checks as long as the border value is one
+    that they ignore.
+*/
+template <typename T>
+class Grid {
+private:
+    int width;
+    int height;
+    int stride;
+    int border;
+    size_t origin; // index of the cell at (0, 0)
+    vector<T> cells;
+
+public:
+    /*
+        Default constructor for an empty grid.
+    */
+    Grid ()
+    {
+        width = 0;
+        height = 0;
+        stride = 0;
+        border = 0;
+        origin = 0;
+    }
+
+    /*
+        Constructor for a width x height grid with every cell, including
+        the border, set to value.
+
+        @param width The number of columns
+        @param height The number of rows
+        @param value The initial value of every cell
+        @param border The number of sentinel cells on each side
+    */
+    Grid (int width, int height, T value = T(), int border = 0)
+    {
+        reset(width, height, value, border);
+    }
+
+    /*
+        Makes this a width x height grid with every cell, including the
+        border, set to value, as the constructor does. The buffer is reused,
+        so this only allocates if the grid grows past its largest size yet.
+
+        @param width The number of columns
+        @param height The number of rows
+        @param value The value of every cell
+        @param border The number of sentinel cells on each side
+    */
+    void reset (int width, int height, T value = T(), int border = 0)
+    {
+        this->width = width;
+        this->height = height;
+        this->stride = width + 2 * border;
+        this->border = border;
+        this->origin = (size_t)border * stride + border;
+        this->cells.assign((size_t)stride * (height + 2 * border), value);
+    }
+
+    int getWidth () const { return width; }
+    int getHeight () const { return height; }
+    int getStride () const { return stride; }
+    int getBorder () const { return border; }
+    bool empty () const { return width == 0 || height == 0; }
+
+    /*
+        Checks whether the coordinates are inside the grid.
+
+        @param x The column
+        @param y The row
+    */
+    bool isValid (int x, int y) const
+    {
+        return (y >= 0 && y < height && x >= 0 && x < width);
+    }
+
+    /*
+        Returns a pointer to the cell at (0, y), so cells can be accessed
+        with grid[y][x]. Rows and columns in the border are reached with
+        negative indices or indices past the end. No bounds checking is done.
+
+        @param y The row
+    */
+    T * operator[] (int y) { return cells.data() + origin + (ptrdiff_t)y * stride; }
+    const T * operator[] (int y) const { return cells.data() + origin + (ptrdiff_t)y * stride; }
+
+    /*
+        Sets every cell of the grid, including the border, to value.
+
+        @param value The value to be set
+    */
+    void fill (T value)
+    {
+        std::fill(cells.begin(), cells.end(), value);
+    }
+};
+
+#endif
@@ -1,47 +1,236 @@
 #include <iostream>
 #include <vector>
-#include <queue>
-#include "PNG.h"
-#include "skeleton.h"
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include "batch.h"
+#include "server.h"
 
 using namespace std;
+namespace fs = std::filesystem;
 
 /*
-    Prints the distance values of each point, skipping the background points.
-    
-    @param distance_map The distance map to be printed.
- */
-void printDistanceMap (vector<vector<int>> & distance_map)
+    Prints how the program is used.
+*/
+void printUsage ()
 {
-    for (int y = 0; y < distance_map.size(); y++)
-    {
-        for (int x = 0; x < distance_map[y].size(); x++)
-        {
-            if (distance_map[y][x]) cout << distance_map[y][x];
-            else cout << " ";
-            cout  << ((distance_map[y][x] / 100) ? " "  :
-                                           (distance_map[y][x] /  10) ? "  " :
-                                                                        "   ");
-        }
-        cout << endl;
-    }
+    cout << "usage: skeleton [options] [input ...]\n"
+            "\n"
+            "Skeletonizes png images. Each input is a png file or a directory,\n"
+            "whose png files are all skeletonized. With no inputs and no\n"
+            "manifest, the images in ../images are skeletonized.\n"
+            "\n"
+            "options:\n"
+            "  -o, --output DIR     where the outputs go (default ../out)\n"
+            "  -m, --manifest FILE  a file of lines 'input [output]'; an output\n"
+            "                       without one goes to the output directory\n"
+            "  -j, --threads N      images skeletonized at once (default: one\n"
+            "                       per hardware thread)\n"
+            "      --decode-threads N\n"
+            "      --encode-threads N\n"
+            "                       threads that only read or only write\n"
+            "                       images; with either, the images go through\n"
+            "                       separate read, skeletonize and write stages\n"
+            "      --transform-threads N\n"
+            "                       threads the distance transforms of each\n"
+            "                       image are split over (default 1)\n"
+            "      --queue N        the most images waiting between two stages\n"
+            "                       (default 8)\n"
+            "  -e, --emit LIST      comma separated outputs to write, out of\n"
+            "                       recreated, ridge and distance\n"
+            "                       (default recreated)\n"
+            "      --metric NAME    manhattan (default) or euclidean\n"
+            "      --cache DIR      looks outputs up in a cache in DIR before\n"
+            "                       calculating them, and stores them there\n"
+            "                       after\n"
+            "      --serve          serves requests read from stdin instead,\n"
+            "                       replying on stdout (see server.h)\n"
+            "      --socket PATH    serves the clients of a Unix domain socket\n"
+            "                       at PATH instead\n"
+            "      --root DIR       only lets a server's requests use paths\n"
+            "                       inside DIR, taking relative ones from it\n"
+            "  -h, --help           prints this\n";
 }
 
 /*
     Driver code for reading PNGs, skeletonizing them, and recreating the image.
+    The results are reported in the order of the inputs, whatever order the
+    workers finished them in.
 */
-int main () {
-    vector<const char *> filesin = {"../images/apple.png", "../images/batman.png", "../images/discord.png", "../images/cursive.png", "../images/rose.png", "../images/hansolo.png",
-                                    "../images/rectangle.png", "../images/rectangle_border_noise.png", "../images/rectangle_internal_noise.png"};
-    vector<const char *> filesout = {"../out/apple.png", "../out/batman.png", "../out/discord.png", "../out/cursive.png", "../out/rose.png", "../out/hansolo.png",
-                                    "../out/rectangle.png", "../out/rectangle_border_noise.png", "../out/rectangle_internal_noise.png"};
+int main (int argc, char ** argv) {
+    BatchOptions options;
+    options.threads = thread::hardware_concurrency();
+    string output = "../out";
+    vector<string> manifests;
+    vector<string> inputs;
+    bool serve = false;
+    string socket;
+    string root;
+    string cache;
 
-    for (int i = 0; i < filesin.size(); i++)
+    for (int i = 1; i < argc; i++)
     {
-        PNG img(filesin[i]);
-        Skeleton skeleton(img);
-        skeleton.getRecreatedImage().write(filesout[i]);
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else if ((arg == "-o" || arg == "--output") && hasValue)
+        {
+            output = argv[++i];
+        }
+        else if ((arg == "-m" || arg == "--manifest") && hasValue)
+        {
+            manifests.push_back(argv[++i]);
+        }
+        else if ((arg == "-j" || arg == "--threads") && hasValue)
+        {
+            if (!parseCount(argv[++i], 1, options.threads))
+            {
+                cout << "ERROR invalid thread count " << argv[i] << endl;
+                return 2;
+            }
+        }
+        else if (arg == "--decode-threads" && hasValue)
+        {
+            if (!parseCount(argv[++i], 0, options.decode_threads))
+            {
+                cout << "ERROR invalid thread count " << argv[i] << endl;
+                return 2;
+            }
+        }
+        else if (arg == "--encode-threads" && hasValue)
+        {
+            if (!parseCount(argv[++i], 0, options.encode_threads))
+            {
+                cout << "ERROR invalid thread count " << argv[i] << endl;
+                return 2;
+            }
+        }
+        else if (arg == "--transform-threads" && hasValue)
+        {
+            if (!parseCount(argv[++i], 1, options.transform_threads))
+            {
+                cout << "ERROR invalid thread count " << argv[i] << endl;
+                return 2;
+            }
+        }
+        else if (arg == "--queue" && hasValue)
+        {
+            if (!parseCount(argv[++i], 1, options.queue_size))
+            {
+                cout << "ERROR invalid queue size " << argv[i] << endl;
+                return 2;
+            }
+        }
+        else if ((arg == "-e" || arg == "--emit") && hasValue)
+        {
+            if (!parseEmit(argv[++i], options.emit))
+            {
+                cout << "ERROR invalid outputs " << argv[i] << endl;
+                return 2;
+            }
+        }
+        else if (arg == "--metric" && hasValue)
+        {
+            string name = argv[++i];
+            if (name == "manhattan") options.distance_metric = MANHATTAN;
+            else if (name == "euclidean") options.distance_metric = EUCLIDEAN;
+            else
+            {
+                cout << "ERROR unknown metric " << name << endl;
+                return 2;
+            }
+        }
+        else if (arg == "--cache" && hasValue)
+        {
+            cache = argv[++i];
+        }
+        else if (arg == "--serve")
+        {
+            serve = true;
+        }
+        else if (arg == "--socket" && hasValue)
+        {
+            socket = argv[++i];
+        }
+        else if (arg == "--root" && hasValue)
+        {
+            root = argv[++i];
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            cout << "ERROR unknown option " << arg << endl;
+            printUsage();
+            return 2;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+    unique_ptr<ResultCache> result_cache;
+    if (!cache.empty())
+    {
+        result_cache.reset(new ResultCache(cache));
+        options.cache = result_cache.get();
     }
 
-    return 0;
+    if (serve || !socket.empty())
+    {
+        if (!inputs.empty() || !manifests.empty())
+        {
+            cout << "ERROR inputs cannot be given to a server" << endl;
+            return 2;
+        }
+        return socket.empty() ? serveStdin(options, root)
+                              : serveSocket(options, socket, root);
+    }
+    if (inputs.empty() && manifests.empty()) inputs.push_back("../images");
+
+    vector<BatchJob> jobs;
+    for (const string & manifest : manifests)
+    {
+        if (!addManifest(jobs, manifest, output))
+        {
+            cout << manifest << ": ERROR could not read the manifest" << endl;
+            return 2;
+        }
+    }
+    for (const string & input : inputs)
+    {
+        if (fs::is_directory(input))
+        {
+            if (!addDirectory(jobs, input, output))
+            {
+                cout << input << ": ERROR could not read the directory" << endl;
+                return 2;
+            }
+        }
+        else
+        {
+            BatchJob job;
+            job.input = input;
+            job.output = outputFor(output, input);
+            jobs.push_back(job);
+        }
+    }
+
+    error_code error;
+    fs::create_directories(output, error);
+
+    runBatch(jobs, options);
+
+    int failed = 0;
+    for (const BatchJob & job : jobs)
+    {
+        if (job.ok) continue;
+        cout << job.input << ": ERROR " << job.error << endl;
+        failed++;
+    }
+    return failed ? 1 : 0;
 }
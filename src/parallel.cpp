@@ -0,0 +1,62 @@
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "parallel.h"
+
+/*
+    Splits [begin, end) into at most threads contiguous ranges and calls
+    body(index, rangeBegin, rangeEnd) on each one, the first on the calling
+    thread and the rest on their own std::threads. Returns once every range
+    is done. The ranges are numbered from 0 in order, and there are never
+    more than max(threads, 1) of them, so callers can give each range
+    buffers of its own. Every range but the last starts on a multiple of
+    grain from begin, so callers can keep ranges aligned to mask words or
+    SIMD blocks.
+
+    @param begin The start of the range
+    @param end The end of the range (exclusive)
+    @param threads The most threads to use, values below 1 mean 1
+    @param grain The granularity of the ranges
+    @param body The work to do on each range
+*/
+void parallelRanges (int begin, int end, int threads, int grain,
+                     const function<void(int, int, int)> & body)
+{
+    int n = end - begin;
+    if (n <= 0) return;
+    if (grain < 1) grain = 1;
+    int chunks = (n + grain - 1) / grain;
+    if (threads > chunks) threads = chunks;
+    if (threads <= 1)
+    {
+        body(0, begin, end);
+        return;
+    }
+
+    // spread the chunks as evenly as possible over the threads
+    vector<int> bounds(threads + 1);
+    for (int i = 0; i <= threads; i++)
+    {
+        bounds[i] = min(end, begin + (int)((long long)chunks * i / threads) * grain);
+    }
+
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++)
+    {
+        workers.push_back(thread(body, i, bounds[i], bounds[i+1]));
+    }
+    body(0, bounds[0], bounds[1]);
+    for (thread & t : workers) t.join();
+}
+
+/*
+    Like parallelRanges, for bodies that do not need to know which range
+    they are called on: body(rangeBegin, rangeEnd).
+*/
+void parallelFor (int begin, int end, int threads, int grain,
+                  const function<void(int, int)> & body)
+{
+    parallelRanges(begin, end, threads, grain, [&body](int, int b, int e) {
+        body(b, e);
+    });
+}
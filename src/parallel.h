@@ -0,0 +1,33 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+using namespace std;
+
+void parallelRanges (int begin, int end, int threads, int grain,
+                     const function<void(int, int, int)> & body);
+
+void parallelFor (int begin, int end, int threads, int grain,
+                  const function<void(int, int)> & body);
+
+/*
+    Calls the function version with a reference to body, which a function
+    holds without allocating, whatever body captures.
+*/
+template <typename F>
+void parallelFor (int begin, int end, int threads, int grain, const F & body)
+{
+    parallelFor(begin, end, threads, grain, function<void(int, int)>(cref(body)));
+}
+
+/*
+    Calls the function version of parallelRanges with a reference to body.
+*/
+template <typename F>
+void parallelRanges (int begin, int end, int threads, int grain, const F & body)
+{
+    parallelRanges(begin, end, threads, grain, function<void(int, int, int)>(cref(body)));
+}
+
+#endif
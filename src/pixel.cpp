@@ -4,12 +4,11 @@
 
 using namespace std;
 
+// a pixel is just its RGBA bytes; HSL is only worked out when asked for
+static_assert(sizeof(Pixel) == 4, "Pixel should be packed RGBA");
+
 Pixel::Pixel()
 {
-    h = 0;
-    s = 0;
-    l = 0;
-
     r = 0;
     g = 0;
     b = 0;
@@ -17,7 +16,7 @@ Pixel::Pixel()
 }
 
 // https://www.rapidtables.com/convert/color/hsl-to-rgb.html
-void Pixel::updateRGB()
+Pixel::Pixel(double h, double s, double l)
 {
     double c = (1 - abs(2 * l - 1)) * s;
     double x = c * (1 - abs(fmod(h / 60, 2) - 1));
@@ -53,11 +52,13 @@ void Pixel::updateRGB()
     r = round((rprime + m) * 255);
     g = round((gprime + m) * 255);
     b = round((bprime + m) * 255);
+    a = 255;
 }
 
 // https://www.rapidtables.com/convert/color/rgb-to-hsl.html
-void Pixel::updateHSL()
+HSL Pixel::getHSL() const
 {
+    double h, s, l;
     double rprime = ((double)r)/255;
     double gprime = ((double)g)/255;
     double bprime = ((double)b)/255;
@@ -80,18 +81,11 @@ void Pixel::updateHSL()
             h = 60 * fmod((gprime - bprime) / delt, 6);
         } else if (cmax == gprime) {
             h = 60 * ((bprime - rprime) / delt) + 2;
-        } else if (cmax == bprime) {
+        } else { // cmax == bprime
             h = 60 * ((rprime - gprime) / delt) + 4;
         }
     }
-}
-
-Pixel::Pixel(double h, double s, double l)
-{
-    this->h = h;
-    this->s = s;
-    this->l = l;
-    updateRGB();
+    return {h, s, l};
 }
 
 Pixel::Pixel(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
@@ -100,10 +94,9 @@ Pixel::Pixel(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
     this->g = g;
     this->b = b;
     this->a = a;
-    updateHSL();
 }
 
-bool Pixel::approximate(const Pixel & p, unsigned int eps)
+bool Pixel::approximate(const Pixel & p, unsigned int eps) const
 {
     return (abs(this->r - p.r) <= eps &&
             abs(this->g - p.g) <= eps &&
@@ -111,7 +104,7 @@ bool Pixel::approximate(const Pixel & p, unsigned int eps)
             abs(this->a - p.a) <= eps);
 }
 
-bool Pixel::operator==(const Pixel & p)
+bool Pixel::operator==(const Pixel & p) const
 {
     return (this->r == p.r &&
             this->g == p.g &&
@@ -119,20 +112,10 @@ bool Pixel::operator==(const Pixel & p)
             this->a == p.a);
 }
 
-bool Pixel::operator!=(const Pixel & p)
+bool Pixel::operator!=(const Pixel & p) const
 {
     return (this->r != p.r ||
             this->g != p.g ||
             this->b != p.b ||
             this->a != p.a);
 }
-
-Pixel Pixel::operator=(const Pixel & p)
-{
-    this->r = p.r;
-    this->g = p.g;
-    this->b = p.b;
-    this->a = p.a;
-    updateHSL();
-    return *this;
-}
@@ -1,14 +1,13 @@
 #ifndef PIXEL_H
 #define PIXEL_H
 
-class Pixel {
-private:
-    void updateRGB();
-
-    void updateHSL();
+// hue, saturation and lightness of a colour, computed on request
+struct HSL {
+    double h, s, l;
+};
 
+class Pixel {
 public:
-    double h, s, l;
     unsigned char r, g, b, a;
 
     Pixel();
@@ -17,10 +16,11 @@ public:
 
     Pixel(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 
-    bool approximate(const Pixel & p, unsigned int eps);
-    bool operator==(const Pixel & p);
-    bool operator!=(const Pixel & p);
-    Pixel operator=(const Pixel & p);
+    HSL getHSL() const;
+
+    bool approximate(const Pixel & p, unsigned int eps) const;
+    bool operator==(const Pixel & p) const;
+    bool operator!=(const Pixel & p) const;
 
 
 };
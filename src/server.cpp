@@ -0,0 +1,629 @@
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <algorithm>
+#include <csignal>
+#include <condition_variable>
+#include <filesystem>
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/openat2.h>
+#include "server.h"
+#include "boundedqueue.h"
+
+// the most bytes of png data a request may send inline
+#define MAXINLINESIZE (256ULL << 20)
+// the most bytes in a request line, newline included
+#define MAXLINESIZE (16 << 10)
+
+// the directory the files of requests are opened beneath
+struct ServerRoot {
+    string path; // the directory, resolved, or empty for no root
+    int fd = -1; // the directory, open, or -1 for no root
+
+    ServerRoot () {}
+    ServerRoot (const ServerRoot &) = delete;
+    ServerRoot & operator= (const ServerRoot &) = delete;
+
+    ~ServerRoot ()
+    {
+        if (fd >= 0) close(fd);
+    }
+};
+
+/*
+    Opens the root directory of a server.
+
+    @param directory The directory, or empty for no root
+    @param root Set to the open directory
+    @return Whether the directory could be opened
+*/
+static bool openRoot (const string & directory, ServerRoot & root)
+{
+    if (directory.empty()) return true;
+    error_code error;
+    root.path = filesystem::canonical(directory, error).string();
+    if (!error) root.fd = open(root.path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (error || root.fd < 0)
+    {
+        cout << __FUNCTION__ << ": ERROR could not open the root " << directory << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Where the replies to the requests of one client go. Workers send whole
+    replies at once, so replies to requests that finish together do not mix.
+    The stream is closed once the client has sent its last request and
+    every reply has been sent.
+*/
+class Connection {
+private:
+    FILE * out;
+    mutex lock;
+
+public:
+    Connection (FILE * out)
+    {
+        this->out = out;
+    }
+
+    ~Connection ()
+    {
+        fclose(out);
+    }
+
+    /*
+        Sends a reply to the client.
+
+        @param reply The reply
+    */
+    void send (const string & reply)
+    {
+        lock_guard<mutex> guard(lock);
+        fwrite(reply.data(), 1, reply.size(), out);
+        fflush(out);
+    }
+};
+
+// one request and where its reply goes
+struct ServerRequest {
+    string id;
+    int emit = 0;
+    string input;           // the png file, when the data is not inline
+    bool is_inline = false;
+    vector<unsigned char> data; // the png data, when it is inline
+    string output;          // where the outputs are written, or empty to
+                            // send them back in the reply
+    shared_ptr<Connection> connection;
+};
+
+/*
+    Adds a section with an output to a reply.
+
+    @param reply The reply to add to
+    @param name The name of the output
+    @param data The output
+*/
+static void addSection (string & reply, const char * name, const string & data)
+{
+    reply += string(name) + " " + to_string(data.size()) + "\n";
+    reply += data;
+}
+
+/*
+    Opens a file beneath the root directory. The kernel resolves the path,
+    and fails if it leads out of the root, whether through .. or through a
+    symbolic link anywhere along it, the last part included.
+
+    @param root The root directory
+    @param path The file, relative to the root
+    @param flags The flags of open
+    @return the descriptor of the file, or -1
+*/
+static int openBeneath (const ServerRoot & root, const string & path, int flags)
+{
+    open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = flags | O_CLOEXEC;
+    how.mode = (flags & O_CREAT) ? 0666 : 0;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    return syscall(SYS_openat2, root.fd, path.c_str(), &how, sizeof(how));
+}
+
+/*
+    Reads a png file beneath the root directory into memory.
+
+    @param root The root directory
+    @param path The file, relative to the root
+    @param data Set to the contents of the file
+    @return Whether the whole file could be read
+*/
+static bool readBeneath (const ServerRoot & root, const string & path,
+                         vector<unsigned char> & data)
+{
+    int fd = openBeneath(root, path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+              (unsigned long long)info.st_size <= MAXINLINESIZE;
+    if (ok)
+    {
+        data.resize(info.st_size);
+        size_t done = 0;
+        while (done < data.size())
+        {
+            ssize_t n = read(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        ok = done == data.size();
+    }
+    close(fd);
+    return ok;
+}
+
+/*
+    Skeletonizes the image of a request and sends the reply.
+
+    @param request The request
+    @param options The settings of the server
+    @param root The directory the files of the request are opened beneath
+    @param workspace The buffers to calculate in
+*/
+static void handleRequest (ServerRequest & request, const BatchOptions & options,
+                           const ServerRoot & root, SkeletonWorkspace & workspace)
+{
+    BatchJob job;
+    job.input = request.is_inline ? "inline data" : request.input;
+    job.output = request.output;
+
+    // beneath a root, the file is read through the root and then decoded
+    // like inline data
+    if (!request.is_inline && root.fd >= 0 &&
+        !readBeneath(root, request.input, request.data))
+    {
+        request.connection->send("ERROR " + request.id + " could not read the image\n");
+        return;
+    }
+
+    PNG img;
+    bool read;
+    if (request.is_inline || root.fd >= 0)
+    {
+        read = img.read(request.data.data(), request.data.size());
+        if (!read) job.error = "could not read the image";
+        else if (img.getWidth() == 0 || img.getHeight() == 0)
+        {
+            job.error = "the image is empty";
+            read = false;
+        }
+    }
+    else
+    {
+        read = readJob(job, img);
+    }
+    if (!read)
+    {
+        request.connection->send("ERROR " + request.id + " " + job.error + "\n");
+        return;
+    }
+
+    SkeletonOptions skeleton_options = skeletonOptions(options, workspace);
+    Skeleton skeleton(std::move(img), skeleton_options);
+    shared_ptr<CachedSkeleton> cached = cachedOutputs(skeleton, options,
+                                                      skeleton_options);
+    int emit = request.emit;
+    SkeletonOutputs outputs;
+    if (cached)
+    {
+        outputs = outputsOf(*cached);
+    }
+    else
+    {
+        outputs = outputsOf((emit & EMIT_RECREATED) ? &skeleton.getRecreatedImage() : NULL,
+                            (emit & EMIT_RIDGE) ? &skeleton.getRidgePointList() : NULL,
+                            (emit & EMIT_DISTANCE) ? &skeleton.getDistanceMap() : NULL);
+    }
+
+    string reply;
+    if (!job.output.empty())
+    {
+        OutputOpener open = openOutput;
+        if (root.fd >= 0)
+        {
+            open = [&root](const string & path) {
+                return openBeneath(root, path, O_WRONLY | O_CREAT | O_TRUNC);
+            };
+        }
+        writeJob(job, emit, outputs, open);
+        if (job.ok) reply = "OK " + request.id + " 0\n";
+        else reply = "ERROR " + request.id + " " + job.error + "\n";
+    }
+    else
+    {
+        int count = 0;
+        string sections;
+        vector<unsigned char> png;
+        if ((emit & EMIT_RECREATED) && encodeRecreated(outputs, png))
+        {
+            addSection(sections, "recreated", string(png.begin(), png.end()));
+            count++;
+        }
+        if (emit & EMIT_RIDGE)
+        {
+            ostringstream out;
+            printRidgePoints(out, outputs);
+            addSection(sections, "ridge", out.str());
+            count++;
+        }
+        if (emit & EMIT_DISTANCE)
+        {
+            ostringstream out;
+            printDistanceMap(out, outputs);
+            addSection(sections, "distance", out.str());
+            count++;
+        }
+        if ((emit & EMIT_RECREATED) && png.empty())
+            reply = "ERROR " + request.id + " could not encode the recreated image\n";
+        else
+            reply = "OK " + request.id + " " + to_string(count) + "\n" + sections;
+    }
+    // the outputs point into the skeleton, so it is only recycled now
+    skeleton.recycleInto(workspace);
+    request.connection->send(reply);
+}
+
+/*
+    Turns a path of a request into one relative to the root directory, which
+    its file is then opened beneath. Relative paths are taken from the root,
+    and absolute ones have to start with it. This only catches paths that
+    plainly lead out of the root; openBeneath checks the rest, symbolic
+    links included, when the file is opened.
+
+    @param root The root directory
+    @param path The path, which is replaced by the relative one
+    @return Whether the path may be inside the root
+*/
+static bool relativeToRoot (const ServerRoot & root, string & path)
+{
+    if (root.fd < 0) return true;
+    filesystem::path relative(path);
+    if (relative.is_absolute()) relative = relative.lexically_relative(root.path);
+    relative = relative.lexically_normal();
+    if (relative.empty() || *relative.begin() == "..") return false;
+    path = relative.string();
+    return true;
+}
+
+/*
+    Reads a line of at most MAXLINESIZE bytes, newline included.
+
+    @param in The stream to read from
+    @param line Set to the line, without its newline; if the line is too
+                long, to its first MAXLINESIZE bytes
+    @return 1 if a line was read, 0 at the end of the stream and -1 if the
+            line is too long
+*/
+static int readLine (FILE * in, string & line)
+{
+    line.clear();
+    int c;
+    while ((c = getc(in)) != EOF)
+    {
+        if (c == '\n') return 1;
+        if (line.size() + 1 >= MAXLINESIZE) return -1;
+        line += (char)c;
+    }
+    return line.empty() ? 0 : 1;
+}
+
+/*
+    Reads requests from a client until it closes its end, and queues them
+    for the workers. Malformed requests are answered straight away.
+
+    @param in The stream the requests come from
+    @param connection Where the replies go
+    @param queue The queue of the workers
+    @param root The directory the files of requests are opened beneath
+*/
+static void readRequests (FILE * in, shared_ptr<Connection> connection,
+                          BoundedQueue<ServerRequest> & queue, const ServerRoot & root)
+{
+    string line;
+    int status;
+    while ((status = readLine(in, line)) != 0)
+    {
+        istringstream fields(line);
+        ServerRequest request;
+        // like oversized inline data, the rest of the line cannot be told
+        // apart from the next request
+        if (status < 0)
+        {
+            if (!(fields >> request.id)) request.id = "-";
+            connection->send("ERROR " + request.id + " request line is longer than " +
+                             to_string(MAXLINESIZE) + " bytes\n");
+            break;
+        }
+        string outputs;
+        string source;
+        if (!(fields >> request.id)) continue; // blank line
+        if (!(fields >> outputs >> source) || !parseEmit(outputs, request.emit))
+        {
+            connection->send("ERROR " + request.id + " malformed request\n");
+            continue;
+        }
+        fields >> request.output;
+        if (!request.output.empty() && !relativeToRoot(root, request.output))
+        {
+            connection->send("ERROR " + request.id + " output is outside the root\n");
+            continue;
+        }
+
+        if (source.compare(0, 7, "inline:") == 0)
+        {
+            char * end;
+            unsigned long long size = strtoull(source.c_str() + 7, &end, 10);
+            if (*end || end == source.c_str() + 7 || !isdigit((unsigned char)source[7]))
+            {
+                connection->send("ERROR " + request.id + " malformed request\n");
+                continue;
+            }
+            // the data that follows cannot be skipped safely either way, so
+            // the rest of the stream cannot be made sense of
+            if (size > MAXINLINESIZE)
+            {
+                connection->send("ERROR " + request.id + " inline data is larger than " +
+                                 to_string(MAXINLINESIZE) + " bytes\n");
+                break;
+            }
+            request.is_inline = true;
+            try
+            {
+                request.data.resize(size);
+            }
+            catch (const bad_alloc &)
+            {
+                connection->send("ERROR " + request.id + " out of memory\n");
+                break;
+            }
+            if (fread(request.data.data(), 1, size, in) != size)
+            {
+                connection->send("ERROR " + request.id + " incomplete data\n");
+                break;
+            }
+        }
+        else
+        {
+            request.input = source;
+            if (!relativeToRoot(root, request.input))
+            {
+                connection->send("ERROR " + request.id + " input is outside the root\n");
+                continue;
+            }
+        }
+        request.connection = connection;
+        queue.push(std::move(request));
+    }
+}
+
+/*
+    Starts the workers of the server, which take requests off queue until it
+    is done.
+
+    @param options The settings of the server
+    @param root The directory the files of requests are opened beneath
+    @param queue The queue of requests
+    @param workers Filled with the worker threads
+*/
+static void startWorkers (const BatchOptions & options, const ServerRoot & root,
+                          BoundedQueue<ServerRequest> & queue,
+                          vector<thread> & workers)
+{
+    int threads = max(options.threads, 1);
+    for (int i = 0; i < threads; i++)
+    {
+        workers.push_back(thread([&options, &root, &queue]() {
+            SkeletonWorkspace workspace;
+            ServerRequest request;
+            while (queue.pop(request))
+            {
+                // a request that cannot be done must not take the server
+                // down with it
+                try
+                {
+                    handleRequest(request, options, root, workspace);
+                }
+                catch (const exception & e)
+                {
+                    request.connection->send("ERROR " + request.id + " " + e.what() + "\n");
+                }
+                request = ServerRequest();
+            }
+        }));
+    }
+}
+
+/*
+    Serves the requests read from in, replying on out, until in is closed
+    and every request is answered. out is closed once the last reply is
+    sent.
+
+    @param options The settings of the server
+    @param in The stream the requests come from
+    @param out The stream the replies go to
+    @param root The directory the paths of requests must be in, or empty to
+                allow any path
+    @return The exit status of the program
+*/
+int serveStream (const BatchOptions & options, FILE * in, FILE * out,
+                 const string & root)
+{
+    ServerRoot server_root;
+    if (!openRoot(root, server_root))
+    {
+        fclose(out);
+        return 1;
+    }
+
+    BoundedQueue<ServerRequest> queue(options.queue_size, 1);
+    vector<thread> workers;
+    startWorkers(options, server_root, queue, workers);
+
+    readRequests(in, make_shared<Connection>(out), queue, server_root);
+    queue.producerDone();
+    for (thread & t : workers) t.join();
+    return 0;
+}
+
+/*
+    Serves the requests read from stdin, replying on stdout (see
+    serveStream). Anything else the program prints, such as error messages,
+    goes to stderr instead of stdout, so as not to get into the replies.
+
+    @param options The settings of the server
+    @param root The directory the paths of requests must be in, or empty to
+                allow any path
+    @return The exit status of the program
+*/
+int serveStdin (const BatchOptions & options, const string & root)
+{
+    cout.flush();
+    FILE * out = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    if (!out)
+    {
+        cout << __FUNCTION__ << ": ERROR could not open stdout" << endl;
+        return 1;
+    }
+    return serveStream(options, stdin, out, root);
+}
+
+/*
+    The clients whose requests are being read, by socket. The readers are
+    detached, so that a server that runs for long does not pile up finished
+    threads, and this is how the server waits for them instead.
+*/
+struct Readers {
+    mutex lock;
+    condition_variable finished;
+    set<int> clients;
+
+    /*
+        Called by a reader once it is done with the queue, before it closes
+        its socket, so the socket is not shut down after it is reused.
+    */
+    void done (int client)
+    {
+        lock_guard<mutex> guard(lock);
+        clients.erase(client);
+        finished.notify_all();
+    }
+
+    /*
+        Stops every reader that is still running and waits for them.
+    */
+    void stopAll ()
+    {
+        unique_lock<mutex> guard(lock);
+        for (int client : clients)
+        {
+            shutdown(client, SHUT_RDWR);
+        }
+        finished.wait(guard, [&]() { return clients.empty(); });
+    }
+};
+
+/*
+    Serves the clients that connect to a Unix domain socket at path, each on
+    a thread of its own that reads its requests, until the program is
+    stopped. A file already at path is replaced.
+
+    @param options The settings of the server
+    @param path Where the socket is made
+    @param root The directory the paths of requests must be in, or empty to
+                allow any path
+    @return The exit status of the program, if it cannot serve
+*/
+int serveSocket (const BatchOptions & options, const string & path,
+                 const string & root)
+{
+    // a client that goes away before its replies are sent must not stop
+    // the server
+    signal(SIGPIPE, SIG_IGN);
+
+    ServerRoot server_root;
+    if (!openRoot(root, server_root)) return 1;
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        cout << __FUNCTION__ << ": ERROR socket path is too long" << endl;
+        return 1;
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (server < 0 || bind(server, (sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(server, SOMAXCONN) < 0)
+    {
+        cout << __FUNCTION__ << ": ERROR could not listen on " << path << ": "
+             << strerror(errno) << endl;
+        return 1;
+    }
+
+    BoundedQueue<ServerRequest> queue(options.queue_size, 1);
+    vector<thread> workers;
+    startWorkers(options, server_root, queue, workers);
+    Readers readers;
+
+    while (true)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0)
+        {
+            if (errno == EINTR) continue;
+            cout << __FUNCTION__ << ": ERROR " << strerror(errno) << endl;
+            break;
+        }
+        {
+            lock_guard<mutex> guard(readers.lock);
+            readers.clients.insert(client);
+        }
+        thread([client, &queue, &readers, &server_root]() {
+            FILE * in = fdopen(client, "r");
+            FILE * out = fdopen(dup(client), "w");
+            if (in && out)
+                readRequests(in, make_shared<Connection>(out), queue, server_root);
+            else if (out)
+                fclose(out);
+            readers.done(client);
+            if (in) fclose(in);
+            else close(client);
+        }).detach();
+    }
+
+    // the readers use the queue, so they have to be done before it goes
+    close(server);
+    readers.stopAll();
+    queue.producerDone();
+    for (thread & t : workers) t.join();
+    return 1;
+}
@@ -0,0 +1,61 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <cstdio>
+#include "batch.h"
+
+using namespace std;
+
+/*
+    A long running mode that skeletonizes images as requests for them come
+    in, on a pool of workers that is started once and keeps its workspaces
+    warm from one request to the next.
+
+    Requests are lines of the form
+
+        <id> <outputs> <input> [<output>]
+
+    where id is any word the client picks, outputs is a comma separated list
+    as for --emit, and input is a png file, or inline:<size> with size bytes
+    of png data right after the newline. With an output, the outputs are
+    written next to it as a batch would write them, and the reply is
+
+        OK <id> 0
+
+    Without one they are sent back in the reply, as
+
+        OK <id> <count>
+        <name> <size>
+        <size bytes of data>
+        ...
+
+    with one section for each output asked for: recreated (png data), ridge
+    and distance (text, as in their files). A request that fails is answered
+    with
+
+        ERROR <id> <message>
+
+    Replies are sent as requests finish, which need not be in the order they
+    came in. A request line longer than 16 KiB, or with more inline data
+    than the server takes (256 MiB), is answered with an ERROR and ends the
+    client's requests, since what follows it cannot be told apart from the
+    next request. The id of such an ERROR is - if the line has none.
+
+    The paths of requests are opened and written with the rights of the
+    server, so a client can read any png file and write outputs anywhere the
+    server can. With a root directory, relative paths are taken from it and
+    every file, the inputs and each output, is opened beneath it with
+    openat2, so paths that lead out of it, through .. or symbolic links, are
+    refused; without one, only let trusted clients connect.
+*/
+
+int serveStream (const BatchOptions & options, FILE * in, FILE * out,
+                 const string & root = "");
+
+int serveStdin (const BatchOptions & options, const string & root = "");
+
+int serveSocket (const BatchOptions & options, const string & path,
+                 const string & root = "");
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+    Thin macros over the widest integer SIMD instruction set the build
+    targets, AVX2 and then SSE2, working on LANES 32-bit integers at a time.
+    SIMD is defined when either one is available; otherwise LANES is 1 and
+    callers use their scalar loops only.
+*/
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define SIMD 1
+static const int LANES = 8;
+
+#define VEC __m256i
+#define VLOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define VSET1(n) _mm256_set1_epi32(n)
+#define VZERO() _mm256_setzero_si256()
+#define VADD(a, b) _mm256_add_epi32(a, b)
+#define VSUB(a, b) _mm256_sub_epi32(a, b)
+#define VAND(a, b) _mm256_and_si256(a, b)
+#define VOR(a, b) _mm256_or_si256(a, b)
+#define VMIN(a, b) _mm256_min_epi32(a, b)
+#define VCMPGT(a, b) _mm256_cmpgt_epi32(a, b)
+#define VSHIFTL(v, n) _mm256_slli_epi32(v, n)
+#define VLANE_INDEX() _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#define VFIRST(v) _mm256_cvtsi256_si32(v)
+#define VLAST(v) _mm256_extract_epi32(v, 7)
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define SIMD 1
+static const int LANES = 4;
+
+// SSE2 has no 32-bit min
+static inline __m128i min32 (__m128i a, __m128i b)
+{
+    __m128i agtb = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(agtb, b), _mm_andnot_si128(agtb, a));
+}
+
+#define VEC __m128i
+#define VLOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define VSET1(n) _mm_set1_epi32(n)
+#define VZERO() _mm_setzero_si128()
+#define VADD(a, b) _mm_add_epi32(a, b)
+#define VSUB(a, b) _mm_sub_epi32(a, b)
+#define VAND(a, b) _mm_and_si128(a, b)
+#define VOR(a, b) _mm_or_si128(a, b)
+#define VMIN(a, b) min32(a, b)
+#define VCMPGT(a, b) _mm_cmpgt_epi32(a, b)
+#define VSHIFTL(v, n) _mm_slli_epi32(v, n)
+#define VLANE_INDEX() _mm_setr_epi32(0, 1, 2, 3)
+#define VFIRST(v) _mm_cvtsi128_si32(v)
+#define VLAST(v) _mm_cvtsi128_si32(_mm_srli_si128(v, 12))
+
+#else
+
+static const int LANES = 1;
+
+#endif
+
+#endif
@@ -1,16 +1,27 @@
 #include <iostream>
 #include <cstdlib>
-#include <queue>
 #include <functional>
 #include <algorithm>
+#include <utility>
 #include "skeleton.h"
+#include "binarize.h"
+#include "distance.h"
+#include "candidates.h"
 
 #define abs(x) ((x) >= 0 ? (x) : (-x))
 
-#define BLACKPIXEL Pixel(0, 0, 0, 255)
 #define WHITEPIXEL Pixel(255, 255, 255, 255)
 #define GREYPIXEL Pixel(100, 100, 100, 255)
 
+// sentinel borders around the grids, wide enough for every neighbour the
+// labelling and linking look at, so none of their loops check bounds
+#define DISTANCEBORDER 1
+#define RIDGEBORDER 1
+#define WINDOWBORDER 2
+
+// distance map rows the labelling looks at around the row it labels
+#define WINDOWROWS 5
+
 /*
     ============================================================================
     ======================= PRIVATE CLASS FUNCTIONS ============================
@@ -18,482 +29,514 @@
 */
 
 /*
-    Checks whether the coordinates are valid in a given vector.
+    Initializes the binary_img mask with the given PNG.
+    The PNG must have black pixels representing the shape, and
+    white pixels representing the background.
+    Pixels within 100 of opaque black in every channel count as the shape.
 
-    @param x The x coordinate (second index of the vector)
-    @param y The y coordinate (first index of the vector)
-    @param v The vector to check the coordinates' validity against
+    @param img The png image used to initialize binary_img
 */
-bool Skeleton::isPixelValid (int x, int y, vector<vector<int>> & v)
+void Skeleton::getBinaryImage(const PNG & img)
 {
-    return (y >= 0 && y < v.size() && x >= 0 && x < v[0].size());
+    binarizeRGBA(img.getRawData(), img.getWidth(), img.getHeight(),
+                 100, this->binary_img);
 }
 
 /*
-    Returns the pixel's distance value in the distance map,
-    returns 0 if the pixel is invalid.
+    Initializes the distance_map grid with distance values
+    of each pixel: the Manhattan distance to the border, or the squared
+    Euclidean distance if the options ask for it.
+    See distance.h for how the transforms work.
 
-    @param x The x coordinate of the pixel
-    @param y The y coordinate of the pixel
-    @return The distance value of the pixel at (x, y)
-*/
-int Skeleton::getPixelDistance (int x, int y)
-{
-    if (!isPixelValid(x, y, this->distance_map))
-        return 0;
-    return this->distance_map[y][x];
-}
+    The map is set up here, with cells just wide enough for the largest
+    distance an image of this size can have under the chosen metric, in the
+    buffer of a recycled map if the workspace has one.
 
-/*
-    Sets the pixel's distance value in the distance map,
-    does nothing if the pixel's coordinates are invalid
+    Precondition: binary_img is initialized.
 
-    @param x The x coordinate of the pixel
-    @param y The y coordinate of the pixel
-    @param distVal The distance value to be set
+    @param ws The workspace to calculate in
 */
-void Skeleton::setPixelDistance (int x, int y, int distVal)
+void Skeleton::calculateDistanceMap (SkeletonWorkspace &ws)
 {
-    if (!isPixelValid(x, y, this->distance_map))
+    int width = this->binary_img.getWidth();
+    int height = this->binary_img.getHeight();
+    int threads = this->options.threads;
+    this->distance_map = std::move(ws.distance_map);
+    if (this->options.distance_metric == EUCLIDEAN)
     {
-        cout << __FUNCTION__ << ": ERROR could not set pixel distance at x=" << x << " y=" << y << endl;
-        return;
+        this->distance_map.reset(width, height,
+                                 euclideanDistanceBound(width, height),
+                                 DISTANCEBORDER);
+        this->distance_map.visit([&](auto & dist) {
+            euclideanDistance(this->binary_img, dist, ws.distance_scratch, threads);
+        });
+    }
+    else
+    {
+        this->distance_map.reset(width, height,
+                                 manhattanDistanceBound(width, height),
+                                 DISTANCEBORDER);
+        this->distance_map.visit([&](auto & dist) {
+            manhattanDistance(this->binary_img, dist, ws.distance_scratch, threads);
+        });
     }
-    this->distance_map[y][x] = distVal;
 }
 
-
 /*
-    Initializes the binary_img vector with the given PNG.
-    The PNG must have black pixels representing the shape, and
-    white pixels representing the background.
+    Helper function to label ridge candidate points by how strong of a ridge
+    indicator it is.
+    The four relevant patterns, or prominent sign barriers, are +-, +0-, +0,
+    and 0-.
 
-    @param img The png image used to initialize binary_img
+    STRONG: +- and +0-
+    GOOD: +0 or -0 on both scan lines
+    WEAK: +0 or -0 on one scan line
+    NONE: does not match any of the four patterns above.
+
+    The scan values are the transitions between neighbouring distance values,
+    eg. we have two pixels | 1 | 2 | and we are scanning in the x direction.
+        Then, the x scan value of the pixel with distance value 2 is 1,
+        and that positive value would contribute a + to the pattern.
+    They are worked out on the fly from the neighbouring distance map rows,
+    and the patterns are looked up in tables (see candidates.cpp). The
+    kernels read the rows as ints, so the rows are copied into a small
+    window of the last few rows; its zero border stands in for the pixels
+    left of, right of and above the map.
+
+    This is a single sweep over the distance map with no scan map buffers.
+    The STRONG labelling for the y scan line must come after all the labels
+    from the x scan line to produce a cleaner skeleton; otherwise, if two
+    seemingly equally valid STRONG points are presented, a redundant one may
+    be chosen (this only occurs in the +0- case). Since the y scan line only
+    looks one row down, labelling row y for the y scan line right after row
+    y+1 has been labelled for the x scan line keeps that ordering.
+
+    @param ridge_prominency The label values for each point
+    @param window Space for the distance map rows being looked at
 */
-void Skeleton::getBinaryImage(PNG & img)
+void Skeleton::labelCandidates (Grid<prominency> &ridge_prominency, Grid<int> &window)
 {
-    for (int y = 0; y < img.getHeight(); y++)
+    int width = this->distance_map.getWidth();
+    int height = this->distance_map.getHeight();
+
+    // distance map row y is kept in row y % WINDOWROWS of the window; the
+    // rows above the map are never loaded, so they stay 0. Only the missing
+    // row below the map has to be told apart, since it is OUTSIDE.
+    window.reset(width, WINDOWROWS, 0, WINDOWBORDER);
+    auto dist = [&](int y) { return window[(y + WINDOWROWS) % WINDOWROWS]; };
+    auto load = [&](int y) {
+        this->distance_map.visit([&](auto & map) {
+            copy(map[y], map[y] + width, dist(y));
+        });
+    };
+
+    if (height > 0) load(0);
+    for (int y = 0; y <= height; y++)
     {
-        for (int x = 0; x < img.getWidth(); x++)
+        if (y+1 < height) load(y+1);
+        if (y < height)
         {
-            if (img.getPixel(x, y).approximate(BLACKPIXEL, 100))
-            {
-                this->binary_img[y][x] = 1;
-            }
+            labelScanXRow(dist(y-1), dist(y), y+1 < height ? dist(y+1) : NULL,
+                          width, ridge_prominency[y]);
+        }
+        if (y > 0)
+        {
+            labelScanYRow(dist(y-3), dist(y-2), dist(y-1),
+                          y < height ? dist(y) : NULL, width,
+                          ridge_prominency[y-1],
+                          y < height ? ridge_prominency[y] : NULL);
         }
     }
 }
 
 /*
-    Initializes the distance_map vector with distance values
-    of each pixel (Manhattan distance to the border).
+    First pass to choose all the ridge point candidates that have the label
+    STRONG or GOOD.
+    Also collects the chosen points with fewer than two neighbours on the
+    skeleton, the only ones the second pass may extend a branch from.
 
-    Precondition: The distance_map vector is initialized
-    to be a height x width 2d vector, with 0 as the default
-    value.
+    @param ridge_prominency The label values for each point
+    @param visited The points already considered for the skeleton
+    @param endpoints The candidate endpoints, in raster order
+    @param chosen Space for the points the pass chooses
 */
-void Skeleton::calculateDistanceMap ()
+void Skeleton::ridgePointsFirstPass (Grid<prominency> &ridge_prominency,
+                                     Grid<char> &visited,
+                                     vector<pair<int,int>> &endpoints,
+                                     vector<pair<int,int>> &chosen)
 {
-    // start from top-left corner, moving right and down
-    for (int y = 0; y < this->binary_img.size(); y++)
+    chosen.clear();
+    for (int y = 0; y < ridge_prominency.getHeight(); y++)
     {
-        for (int x = 0; x < this->binary_img[y].size(); x++)
+        for (int x = 0; x < ridge_prominency.getWidth(); x++)
         {
-            if (this->binary_img[y][x])
+            // add all the points labelled STRONG and GOOD to the skeleton
+            if (ridge_prominency[y][x] == STRONG ||
+                ridge_prominency[y][x] == GOOD)
             {
-                // take the minimum of the left and top neighbours + 1
-                int minTLDist = min(getPixelDistance(x-1, y) + 1,
-                                    getPixelDistance(x, y-1) + 1);
-                setPixelDistance(x, y, minTLDist);
+                this->ridge_points[y][x] = ridge_prominency[y][x];
+                this->ridge_list.push_back({x, y, this->distance_map[y][x],
+                                            ridge_prominency[y][x]});
+                visited[y][x] = true;
+                chosen.push_back({x, y});
+                joinSegments(x, y);
             }
         }
     }
 
-    // start from bottom-right corner, moving left and up
-    for (int y = this->binary_img.size()-1; y >= 0; y--)
+    // neighbours can only be counted once every point is in
+    for (pair<int,int> coord : chosen)
     {
-        for (int x = this->binary_img[y].size()-1; x >= 0; x--)
-        {
-            if (this->binary_img[y][x])
-            {
-                // take the minimum of the right and bottom neighbours + 1
-                // and the current distance value
-                int minBRDist = min(getPixelDistance(x+1, y) + 1,
-                                    min(getPixelDistance(x, y+1) + 1,
-                                        this->distance_map[y][x]));
-                setPixelDistance(x, y, minBRDist);
-            }
-        }
+        int dx, dy;
+        if (countRidgeNeighbours(coord.first, coord.second, dx, dy) < 2)
+            endpoints.push_back(coord);
     }
 }
 
 /*
-    Helper function to calculate the transition values between points,
-    eg. We have two pixels | 1 | 2 | and we are scanning in the x direction.
-        Then, the value of scanX for the pixel with distance value 2 is 1,
-        and that positive value would contribute a + to the pattern finding
-        in the labelling step.
-
-    @param scanX The scan map for the scan line going in the x direction
-    @param scanY The scan map for the scan line going in the y direction
+    Counts the neighbours (8 neighbours) the point has on the skeleton.
+    dx and dy are set to point away from the last neighbour found, which is
+    the direction to go when seeking new points.
+
+    @param x The x coordinate of the point
+    @param y The y coordinate of the point
+    @param dx Set to the x direction to extend a branch in
+    @param dy Set to the y direction to extend a branch in
+    @return The number of neighbours on the skeleton
 */
-void Skeleton::calculateScanMap (vector<vector<int>> &scanX,
-                                 vector<vector<int>> &scanY)
+int Skeleton::countRidgeNeighbours (int x, int y, int &dx, int &dy)
 {
-    for (int y = 0; y < this->distance_map.size(); y++)
+    int countNeighbours = 0;
+    dx = 0; // deltas determine which direction we should go when
+    dy = 0; // seeking new points
+
+    if (this->ridge_points[y][x+1] != NONE) // right
     {
-        for (int x = 0; x < this->distance_map[y].size(); x++)
-        {
-            scanX[y][x] = getPixelDistance(x, y) - getPixelDistance(x-1,   y);
-            scanY[y][x] = getPixelDistance(x, y) - getPixelDistance(  x, y-1);
-        }
+        countNeighbours++;
+        dx = -1;
     }
-}
+    if (this->ridge_points[y-1][x] != NONE) // top
+    {
+        countNeighbours++;
+        dy = 1;
+    }
+    if (this->ridge_points[y][x-1] != NONE) // left
+    {
+        countNeighbours++;
+        dx = 1;
+    }
+    if (this->ridge_points[y+1][x] != NONE) // bottom
+    {
+        countNeighbours++;
+        dy = -1;
+    }
+    if (this->ridge_points[y-1][x+1] != NONE) // upper right
+    {
+        countNeighbours++;
+        dx = -1;
+        dy = 1;
 
-/*
-    Helper function to label ridge candidate points by how strong of a ridge
-    indicator it is.
-    The four relevant patterns, or prominent sign barriers, are +-, +0-, +0,
-    and 0-.
+    }
+    if (this->ridge_points[y-1][x-1] != NONE) // upper left
+    {
+        countNeighbours++;
+        dx = 1;
+        dy = 1;
+    }
+    if (this->ridge_points[y+1][x-1] != NONE) // lower left
+    {
+        countNeighbours++;
+        dx = 1;
+        dy = -1;
+    }
+    if (this->ridge_points[y+1][x+1]) // lower right
+    {
+        countNeighbours++;
+        dx = -1;
+        dy = -1;
+    }
 
-    STRONG: +- and +0-
-    GOOD: +0 or -0 on both scan lines
-    WEAK: +0 or -0 on one scan line
-    NONE: does not match any of the four patterns above.
+    return countNeighbours;
+}
 
+/*
+    Adds the skeleton point (x, y) to the segment bookkeeping and merges its
+    segment with those of its 8 neighbours already on the skeleton.
 
+    @param x The x coordinate of the point
+    @param y The y coordinate of the point
 */
-void Skeleton::labelCandidates (vector<vector<int>> &scanX,
-                                vector<vector<int>> &scanY,
-                                vector<vector<prominency>> &ridge_prominency)
+void Skeleton::joinSegments (int x, int y)
 {
-    // the STRONG labelling for scanX, as well as the GOOD and WEAK labelling
-    // for both scanX and scanY, are done in this double for loop.
-    for (int y = 0; y < this->distance_map.size(); y++)
-    {
-        for (int x = 0; x < this->distance_map[y].size(); x++)
-        {
-            // scanX STRONG labels
-            // +0-
-            if (isPixelValid(x-1, y, scanX) && isPixelValid(x+1, y, scanX) &&
-                scanX[y][x-1] > 0 && scanX[y][x] == 0 && scanX[y][x+1] < 0)
-            {
-                ridge_prominency[y][x] = STRONG;
-            }
-            // +-
-            else if (isPixelValid(x+1, y, scanX) && scanX[y][x] > 0 &&
-                     scanX[y][x+1] < 0)
-            {
-                ridge_prominency[y][x] = STRONG;
-            }
-
-            // WEAK and GOOD prominency points (both scanX and scanY)
-            if (ridge_prominency[y][x] == NONE)
-            {
-                // +0 or 0- on both scan lines
-                if (isPixelValid(x+1, y, scanX) &&
-                    ((scanX[y][x] > 0 && scanX[y][x+1] == 0) || (scanX[y][x] == 0 && scanX[y][x+1] < 0)) &&
-                    isPixelValid(x, y+1, scanY) &&
-                    ((scanY[y][x] > 0 && scanY[y+1][x] == 0) || (scanY[y][x] == 0 && scanY[y+1][x] < 0)))
-                {
-                    ridge_prominency[y][x] = GOOD;
-                }
-                // +0 or 0- on one scan line
-                else if ((isPixelValid(x+1, y, scanX) &&
-                    ((scanX[y][x] > 0 && scanX[y][x+1] == 0) || (scanX[y][x] == 0 && scanX[y][x+1] < 0))) ||
-                    (isPixelValid(x, y+1, scanY) &&
-                    ((scanY[y][x] > 0 && scanY[y+1][x] == 0) || (scanY[y][x] == 0 && scanY[y+1][x] < 0))))
-                {
-                    ridge_prominency[y][x] = WEAK;
-                }
-            }
-        }
-    }
-
-    // now the STRONG labelling for scanY. this must be separated from the first
-    // double for loop because all the STRONG points on the x scan line must
-    // be processed first to produce a cleaner skeleton.
-    // otherwise, if two seemingly equally valid STRONG points are presented,
-    // a redundant one may be chosen.
-    // this only occurs in the +0- case.
-    for (int y = 0; y < this->distance_map.size(); y++)
+    int id = this->segments.add();
+    this->segment_ids[y][x] = id;
+    for (int dy = -1; dy <= 1; dy++)
     {
-        for (int x = 0; x < this->distance_map[y].size(); x++)
+        for (int dx = -1; dx <= 1; dx++)
         {
-            // scanY STRONG labels
-            // +0-
-            if (isPixelValid(x, y-1, scanY) && isPixelValid(x, y+1, scanY) &&
-                scanY[y-1][x] > 0 && scanY[y][x] == 0 && scanY[y+1][x] < 0)
-            {
-                // checks whether the other point has already been chosen,
-                // skip the current one if it has
-                if (ridge_prominency[y+1][x] == STRONG) continue;
-                ridge_prominency[y][x] = STRONG;
-            }
-            // +-
-            else if (isPixelValid(x, y+1, scanY) && scanY[y][x] > 0 && scanY[y+1][x] < 0)
-            {
-                ridge_prominency[y][x] = STRONG;
-            }
+            int neighbour = this->segment_ids[y+dy][x+dx];
+            if (neighbour >= 0) this->segments.unite(id, neighbour);
         }
     }
 }
 
 /*
-    First pass to choose all the ridge point candidates that have the label
-    STRONG or GOOD.
+    Checks whether a branch grown from (x, y) touches a skeleton segment other
+    than the one (x, y) is on, ie. whether keeping it links two segments.
 
-    @param ridge_prominency The label values for each point
-    @param visited The points already considered for the skeleton
+    @param x The x coordinate of the point the branch was grown from
+    @param y The y coordinate of the point the branch was grown from
+    @param tentative The points of the branch
+    @return Whether the branch links two segments
 */
-void Skeleton::ridgePointsFirstPass (vector<vector<prominency>> &ridge_prominency,
-                                     vector<vector<bool>> &visited)
+bool Skeleton::branchLinksSegments (int x, int y, vector<pair<int,int>> &tentative)
 {
-    for (int y = 0; y < ridge_prominency.size(); y++)
+    int own = this->segments.find(this->segment_ids[y][x]);
+    for (pair<int,int> coord : tentative)
     {
-        for (int x = 0; x < ridge_prominency[y].size(); x++)
+        for (int dy = -1; dy <= 1; dy++)
         {
-            // add all the points labelled STRONG and GOOD to the skeleton
-            if (ridge_prominency[y][x] == STRONG ||
-                ridge_prominency[y][x] == GOOD)
+            for (int dx = -1; dx <= 1; dx++)
             {
-                this->ridge_points[y][x] = ridge_prominency[y][x];
-                visited[y][x] = true;
+                int neighbour = this->segment_ids[coord.second + dy][coord.first + dx];
+                if (neighbour >= 0 && this->segments.find(neighbour) != own)
+                    return true;
             }
         }
     }
+    return false;
 }
 
 /*
-    Second pass to link disconnected segments of the skeleton by choosing
-    WEAK points or, if no WEAK points are available, points with the greatest
-    distance value.
-
-    WARNING: this function is a monstrosity.
+    Extends a tentative branch from the point (x, y) in the direction (dx, dy),
+    following WEAK points or, if there are none, the neighbour with the
+    greatest distance value, until it runs into the established skeleton.
+
+    @param x The x coordinate of the point to extend from
+    @param y The y coordinate of the point to extend from
+    @param dx The x direction to extend in
+    @param dy The y direction to extend in
+    @param ridge_prominency The label values for each point
+    @param visited The points already considered for the skeleton
+    @param tentative Filled with the points of the branch
+    @return Whether the branch joined the skeleton
 */
-void Skeleton::ridgePointsSecondPass (vector<vector<prominency>> &ridge_prominency,
-                                      vector<vector<bool>> &visited)
+bool Skeleton::extendBranch (int x, int y, int dx, int dy,
+                             Grid<prominency> &ridge_prominency,
+                             Grid<char> &visited,
+                             vector<pair<int,int>> &tentative)
 {
-    // iterate through all points to find the points already in the skeleton
-    for (int y = 0; y < ridge_prominency.size(); y++)
+    // coordinates of current point on the tentative branch
+    int currx = x;
+    int curry = y;
+
+    // keep extending the branch until it runs out of points to go to
+    // (fail case) or into the skeleton (success case). Nothing here looks
+    // further than one pixel away, and the borders of the grids are NONE,
+    // not visited and 0, so the branch never leaves the image.
+    while (true)
     {
-        for (int x = 0; x < ridge_prominency[y].size(); x++)
+        // coordinates of the next point to go to
+        int tmpx = currx;
+        int tmpy = curry;
+
+        // weak point moving in x direction
+        if (dx && ridge_prominency[curry][currx+dx] != NONE)
+        {
+            tmpx = currx+dx;
+        }
+        // weak point moving in y direction
+        if (dy && ridge_prominency[curry+dy][currx] != NONE)
         {
-            if (this->ridge_points[y][x] == NONE) continue;
-            int countNeighbours = 0;
-            int dx = 0; // deltas determine which direction we should go when
-            int dy = 0; // seeking new points
-
-            // counting the number of neighbours the point currently has
-            // (8 neighbours)
-            if (isPixelValid(x+1, y, this->ridge_points) && // right
-                this->ridge_points[y][x+1] != NONE)
+            tmpy = curry+dy;
+        }
+        // no weak points around, find point with max distance val
+        if (currx == tmpx && curry == tmpy)
+        {
+            int currMax = 0;
+            // check every neighbour, skip the ones already in the
+            // skeleton
+            if (this->ridge_points[curry][currx+1] == NONE && // right
+                abs(distance_map[curry][currx+1]) > currMax)
             {
-                countNeighbours++;
-                dx = -1;
+                currMax = abs(distance_map[curry][currx+1]);
+                tmpx = currx+1;
+                tmpy = curry;
             }
-            if (isPixelValid(x, y-1, this->ridge_points) && // top
-                this->ridge_points[y-1][x] != NONE)
+            if (this->ridge_points[curry][currx-1] == NONE && // left
+                abs(distance_map[curry][currx-1]) > currMax)
             {
-                countNeighbours++;
-                dy = 1;
+                currMax = abs(distance_map[curry][currx-1]);
+                tmpx = currx-1;
+                tmpy = curry;
             }
-            if (isPixelValid(x-1, y, this->ridge_points) && // left
-                this->ridge_points[y][x-1] != NONE)
+            if (this->ridge_points[curry+1][currx] == NONE && // bottom
+                abs(distance_map[curry+1][currx]) > currMax)
             {
-                countNeighbours++;
-                dx = 1;
+                currMax = abs(distance_map[curry+1][currx]);
+                tmpx = currx;
+                tmpy = curry+1;
             }
-            if (isPixelValid(x, y+1, this->ridge_points) && // bottom
-                this->ridge_points[y+1][x] != NONE)
+            if (this->ridge_points[curry-1][currx] == NONE && // top
+                abs(distance_map[curry-1][currx]) > currMax)
             {
-                countNeighbours++;
-                dy = -1;
+                currMax = abs(distance_map[curry-1][currx]);
+                tmpx = currx;
+                tmpy = curry-1;
             }
-            if (isPixelValid(x+1, y-1, this->ridge_points) && // upper right
-                this->ridge_points[y-1][x+1] != NONE)
+            if (this->ridge_points[curry+1][currx+1] == NONE && // bottom right
+                abs(distance_map[curry+1][currx+1]) > currMax)
             {
-                countNeighbours++;
-                dx = -1;
-                dy = 1;
-
+                currMax = abs(distance_map[curry+1][currx+1]);
+                tmpx = currx+1;
+                tmpy = curry+1;
             }
-            if (isPixelValid(x-1, y-1, this->ridge_points) && // upper left
-                this->ridge_points[y-1][x-1] != NONE)
+            if (this->ridge_points[curry-1][currx-1] == NONE && // top left
+                abs(distance_map[curry-1][currx-1]) > currMax)
             {
-                countNeighbours++;
-                dx = 1;
-                dy = 1;
+                currMax = abs(distance_map[curry-1][currx-1]);
+                tmpx = currx-1;
+                tmpy = curry-1;
             }
-            if (isPixelValid(x-1, y+1, this->ridge_points) && // lower left
-                this->ridge_points[y+1][x-1] != NONE)
+            if (this->ridge_points[curry-1][currx+1] == NONE && // top right
+                abs(distance_map[curry-1][currx+1]) > currMax)
             {
-                countNeighbours++;
-                dx = 1;
-                dy = -1;
+                currMax = abs(distance_map[curry-1][currx+1]);
+                tmpx = currx+1;
+                tmpy = curry-1;
             }
-            if (isPixelValid(x+1, y+1, this->ridge_points) && // lower right
-                this->ridge_points[y+1][x+1])
+            if (this->ridge_points[curry+1][currx-1] == NONE && // bottom left
+                abs(distance_map[curry+1][currx-1]) > currMax)
             {
-                countNeighbours++;
-                dx = -1;
-                dy = -1;
+                currMax = abs(distance_map[curry+1][currx-1]);
+                tmpx = currx-1;
+                tmpy = curry+1;
             }
+        }
 
-            // extend tentative branch if point has less than 2 neighbours
-            if (countNeighbours < 2)
-            {
-                // coordinates of current point on the tentative branch
-                int currx = x;
-                int curry = y;
-                vector<pair<int,int>> tentative; // stores all points in
-                                                 // tentative branch
-                // keep extending the branch until the pixel is invalid
-                // (fail case; there are breaks in the middle for the success case)
-                while (isPixelValid(currx, curry, this->ridge_points))
-                {
-                    // coordinates of the next point to go to
-                    int tmpx = currx;
-                    int tmpy = curry;
-
-                    // weak point moving in x direction
-                    if (dx && isPixelValid(currx+dx, curry, this->ridge_points) &&
-                        ridge_prominency[curry][currx+dx] != NONE)
-                    {
-                        tmpx = currx+dx;
-                    }
-                    // weak point moving in y direction
-                    if (dy && isPixelValid(currx, curry+dy, this->ridge_points) &&
-                        ridge_prominency[curry+dy][currx] != NONE)
-                    {
-                        tmpy = curry+dy;
-                    }
-                    // no weak points around, find point with max distance val
-                    if (currx == tmpx && curry == tmpy)
-                    {
-                        int currMax = 0;
-                        // check every neighbour, skip the ones already in the
-                        // skeleton
-                        if (isPixelValid(currx+1, curry, this->ridge_points) && // right
-                            this->ridge_points[curry][currx+1] == NONE &&
-                            abs(distance_map[curry][currx+1]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry][currx+1]);
-                            tmpx = currx+1;
-                            tmpy = curry;
-                        }
-                        if (isPixelValid(currx-1, curry, this->ridge_points) && // left
-                            this->ridge_points[curry][currx-1] == NONE &&
-                            abs(distance_map[curry][currx-1]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry][currx-1]);
-                            tmpx = currx-1;
-                            tmpy = curry;
-                        }
-                        if (isPixelValid(currx, curry+1, this->ridge_points) && // bottom
-                            this->ridge_points[curry+1][currx] == NONE &&
-                            abs(distance_map[curry+1][currx]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry+1][currx]);
-                            tmpx = currx;
-                            tmpy = curry+1;
-                        }
-                        if (isPixelValid(currx, curry-1, this->ridge_points) && // top
-                            this->ridge_points[curry-1][currx] == NONE &&
-                            abs(distance_map[curry-1][currx]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry-1][currx]);
-                            tmpx = currx;
-                            tmpy = curry-1;
-                        }
-                        if (isPixelValid(currx+1, curry+1, this->ridge_points) && // bottom right
-                            this->ridge_points[curry+1][currx+1] == NONE &&
-                            abs(distance_map[curry+1][currx+1]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry+1][currx+1]);
-                            tmpx = currx+1;
-                            tmpy = curry+1;
-                        }
-                        if (isPixelValid(currx-1, curry-1, this->ridge_points) && // top left
-                            this->ridge_points[curry-1][currx-1] == NONE &&
-                            abs(distance_map[curry-1][currx-1]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry-1][currx-1]);
-                            tmpx = currx-1;
-                            tmpy = curry-1;
-                        }
-                        if (isPixelValid(currx+1, curry-1, this->ridge_points) && // top right
-                            this->ridge_points[curry-1][currx+1] == NONE &&
-                            abs(distance_map[curry-1][currx+1]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry-1][currx+1]);
-                            tmpx = currx+1;
-                            tmpy = curry-1;
-                        }
-                        if (isPixelValid(currx-1, curry+1, this->ridge_points) && // bottom left
-                            this->ridge_points[curry+1][currx-1] == NONE &&
-                            abs(distance_map[curry+1][currx-1]) > currMax)
-                        {
-                            currMax = abs(distance_map[curry+1][currx-1]);
-                            tmpx = currx-1;
-                            tmpy = curry+1;
-                        }
-                    }
-
-                    // if no changes to tmp coordinates, we have no more valid
-                    // points to go to: bump into an invalid position and fail
-                    if (currx == tmpx && curry == tmpy)
-                    {
-                        currx = -1;
-                        curry = -1;
-                        break;
-                    }
-
-                    // set current coordinates to next coordinates
-                    currx = tmpx;
-                    curry = tmpy;
-
-                    // if the current point is already visited, fail
-                    if (visited[curry][currx]) break;
-                    visited[curry][currx] = true;
-
-                    // add coordinates to the tentative branch
-                    tentative.push_back({currx, curry});
-
-                    // check if current point has two or more neighbouring points
-                    // on the ridge line; if so, break with success
-                    int currNeighbourCount = 0;
-                    if (isPixelValid(currx-1, curry, this->ridge_points) &&
-                        visited[curry][currx-1])
-                        currNeighbourCount++;
-                    if (isPixelValid(currx+1, curry, this->ridge_points) &&
-                        visited[curry][currx+1])
-                        currNeighbourCount++;
-                    if (isPixelValid(currx, curry-1, this->ridge_points) &&
-                        visited[curry-1][currx])
-                        currNeighbourCount++;
-                    if (isPixelValid(currx, curry+1, this->ridge_points) &&
-                        visited[curry+1][currx])
-                        currNeighbourCount++;
-
-                    if (currNeighbourCount >= 2) break;
-                } // end of extending tentative branch; now we decide whether
-                  // to keep it
-
-
-                // invalid branch - off the shape or didn't collide with established skeleton
-                if (!isPixelValid(currx, curry, this->ridge_points) ||
-                    this->distance_map[curry][currx] == 0)
-                {
-                    continue;
-                }
+        // if no changes to tmp coordinates, we have no more valid
+        // points to go to: fail
+        if (currx == tmpx && curry == tmpy)
+        {
+            currx = -1;
+            curry = -1;
+            break;
+        }
+
+        // set current coordinates to next coordinates
+        currx = tmpx;
+        curry = tmpy;
+
+        // if the current point is already visited, fail
+        if (visited[curry][currx]) break;
+        visited[curry][currx] = true;
+
+        // add coordinates to the tentative branch
+        tentative.push_back({currx, curry});
+
+        // check if current point has two or more neighbouring points
+        // on the ridge line; if so, break with success
+        int currNeighbourCount = 0;
+        if (visited[curry][currx-1]) currNeighbourCount++;
+        if (visited[curry][currx+1]) currNeighbourCount++;
+        if (visited[curry-1][currx]) currNeighbourCount++;
+        if (visited[curry+1][currx]) currNeighbourCount++;
+
+        if (currNeighbourCount >= 2) break;
+    } // end of extending tentative branch; now we decide whether
+      // to keep it
+
+    // invalid branch - off the shape or didn't collide with established skeleton
+    if (currx < 0 || this->distance_map[curry][currx] == 0)
+    {
+        return false;
+    }
+
+    // success
+    return true;
+}
+
+/*
+    Second pass to link disconnected segments of the skeleton by choosing
+    WEAK points or, if no WEAK points are available, points with the greatest
+    distance value.
 
-                // success - add all branch points to the skeleton
-                for (pair<int,int> coord : tentative)
+    Only endpoints of the skeleton (points with fewer than two neighbours) can
+    grow a branch, so rather than rescanning the image this works through the
+    endpoints from the first pass in raster order. Points added by a branch
+    that come later in raster order are queued as well, since a raster scan
+    would have reached them too. That keeps the result the same as scanning
+    every pixel, at a cost that depends on the size of the skeleton.
+
+    The connected segments of the skeleton are tracked with a disjoint set as
+    branches are added. With the stop_when_connected option, branches that
+    only lead back to their own segment are dropped, and linking stops as
+    soon as the skeleton is in one piece.
+
+    @param ridge_prominency The label values for each point
+    @param visited The points already considered for the skeleton
+    @param endpoints The candidate endpoints from the first pass
+    @param worklist Space for the points still to look at
+    @param tentative Space for the points of a branch
+*/
+void Skeleton::ridgePointsSecondPass (Grid<prominency> &ridge_prominency,
+                                      Grid<char> &visited,
+                                      vector<pair<int,int>> &endpoints,
+                                      vector<long long> &worklist,
+                                      vector<pair<int,int>> &tentative)
+{
+    long long width = this->ridge_points.getWidth();
+
+    // a min-heap of the raster indices (y * width + x) of the points still
+    // to look at
+    worklist.clear();
+    for (pair<int,int> coord : endpoints)
+    {
+        worklist.push_back(coord.second * width + coord.first);
+    }
+    make_heap(worklist.begin(), worklist.end(), greater<long long>());
+
+    while (!worklist.empty())
+    {
+        if (this->options.stop_when_connected && this->segments.count() <= 1)
+            break;
+
+        pop_heap(worklist.begin(), worklist.end(), greater<long long>());
+        long long index = worklist.back();
+        worklist.pop_back();
+        int x = index % width;
+        int y = index / width;
+
+        // extend tentative branch if point has less than 2 neighbours
+        int dx, dy;
+        if (countRidgeNeighbours(x, y, dx, dy) >= 2) continue;
+
+        tentative.clear(); // stores all points in tentative branch
+        if (!extendBranch(x, y, dx, dy, ridge_prominency, visited, tentative))
+            continue;
+        if (this->options.stop_when_connected &&
+            !branchLinksSegments(x, y, tentative))
+        {
+            // leave the points free for a branch that does link segments
+            for (pair<int,int> coord : tentative)
+                visited[coord.second][coord.first] = false;
+            continue;
+        }
+
+        // success - add all branch points to the skeleton
+        for (pair<int,int> coord : tentative)
+        {
+            int bx = coord.first;
+            int by = coord.second;
+            if (this->ridge_points[by][bx] == NONE)
+            {
+                this->ridge_points[by][bx] = WEAK;
+                this->ridge_list.push_back({bx, by, this->distance_map[by][bx], WEAK});
+                joinSegments(bx, by);
+                if (by * width + bx > index)
                 {
-                    int x = coord.first;
-                    int y = coord.second;
-                    if (this->ridge_points[y][x] == NONE) this->ridge_points[y][x] = WEAK;
+                    worklist.push_back(by * width + bx);
+                    push_heap(worklist.begin(), worklist.end(), greater<long long>());
                 }
             }
         }
@@ -501,128 +544,237 @@ void Skeleton::ridgePointsSecondPass (vector<vector<prominency>> &ridge_prominen
 }
 
 /*
-    Main function to find skeleton. This function first calculates the values
-    for the x and y scan maps, then uses the scan map values to label each
-    point based on how strong of a ridge indicator it is. Then, it does two
-    scans to add the appropriate points to the skeleton (ridge_points).
+    Main function to find skeleton. This function first labels each point
+    based on how strong of a ridge indicator it is, from the sign patterns of
+    the distance values along the x and y scan lines. Then, it does two scans
+    to add the appropriate points to the skeleton (ridge_points), listing
+    them in ridge_list as they are added.
+
+    @param ws The workspace to calculate in
 */
-void Skeleton::calculateRidgePoints ()
+void Skeleton::calculateRidgePoints (SkeletonWorkspace &ws)
 {
-    // get the sign of the distance difference between two points
-    vector<vector<int>> scanX(this->distance_map.size(),
-                              vector<int>(this->distance_map[0].size(), 0));
-    vector<vector<int>> scanY(this->distance_map.size(),
-                              vector<int>(this->distance_map[0].size(), 0));
-    // record each point's likelihood of being a ridge point
-    vector<vector<prominency>> ridge_prominency(this->distance_map.size(),
-                              vector<prominency>(this->distance_map[0].size(), NONE));
+    int width = this->distance_map.getWidth();
+    int height = this->distance_map.getHeight();
+
+    this->ridge_points = std::move(ws.ridge_points);
+    this->ridge_points.reset(width, height, NONE, RIDGEBORDER);
+    this->ridge_list = std::move(ws.ridge_list);
+    this->ridge_list.clear();
+    this->segments = std::move(ws.segments);
+    this->segments.clear();
+    this->segment_ids = std::move(ws.segment_ids);
+    this->segment_ids.reset(width, height, -1, RIDGEBORDER);
 
-    // processes all values for both scan maps
-    calculateScanMap(scanX, scanY);
+    // record each point's likelihood of being a ridge point
+    Grid<prominency> &ridge_prominency = ws.ridge_prominency;
+    ridge_prominency.reset(width, height, NONE, RIDGEBORDER);
 
     // labels the ridge point candidates
-    labelCandidates(scanX, scanY, ridge_prominency);
+    labelCandidates(ridge_prominency, ws.window);
 
-    // visited vector prevents the algorithm from choosing points that go in a
+    // visited grid prevents the algorithm from choosing points that go in a
     // circle forever
-    vector<vector<bool>> visited(this->ridge_points.size(),
-                                 vector<bool>(this->ridge_points[0].size()));
+    Grid<char> &visited = ws.visited;
+    visited.reset(width, height, false, RIDGEBORDER);
 
     // first pass
-    ridgePointsFirstPass(ridge_prominency, visited);
+    ws.endpoints.clear();
+    ridgePointsFirstPass(ridge_prominency, visited, ws.endpoints, ws.chosen);
 
     // second pass
-    ridgePointsSecondPass(ridge_prominency, visited);
+    ridgePointsSecondPass(ridge_prominency, visited, ws.endpoints,
+                          ws.worklist, ws.tentative);
+
+    // only the number of segments is kept
+    ws.segment_ids = std::move(this->segment_ids);
+    this->segment_ids = Grid<int>();
+
+    // the first pass lists its points in raster order, but the branches of
+    // the second pass are added as they are found
+    sort(this->ridge_list.begin(), this->ridge_list.end(),
+         [](const RidgePoint & a, const RidgePoint & b) {
+             return a.y < b.y || (a.y == b.y && a.x < b.x);
+         });
 }
 
 /*
     Recreates the image based on the skeleton of the image and the distance map.
+
+    With the Manhattan metric, every ridge point covers the Manhattan diamond
+    centered on it with radius equal to its distance value. Rather than
+    flooding each diamond separately, this does a reverse distance transform:
+    coverage[y][x] holds the largest number of steps any ridge point still has
+    left on reaching (x, y), and two raster passes propagate it the same way
+    calculateDistanceMap propagates distances. A pixel is inside the recreated
+    shape if coverage is not negative.
+    With the Euclidean metric, every ridge point covers the open disc that
+    reaches its nearest border point (see euclideanCoverage).
+    Both take O(width x height) time and memory.
+
+    @param ws The workspace to calculate in
 */
-void Skeleton::recreateImage ()
+void Skeleton::recreateImage (SkeletonWorkspace &ws)
 {
-    if (this->distance_map.size() == 0 ||
-        this->distance_map.size() != this->ridge_points.size() ||
-        this->distance_map[0].size() != this->ridge_points[0].size())
+    if (this->distance_map.empty() ||
+        this->distance_map.getHeight() != this->ridge_points.getHeight() ||
+        this->distance_map.getWidth() != this->ridge_points.getWidth())
     {
         cout << __FUNCTION__ << ": ERROR distance map and local maxes size mismatch" << endl;
         return;
     }
 
-    // visited[y][x][d], tracks if we've already processed the point (x, y)
-    // with remaining steps d
-    vector<vector<vector<bool>>> visited(this->distance_map.size(),
-                                         vector<vector<bool>>(this->distance_map[0].size(),
-                                         vector<bool>(this->distance_map.size() + this->distance_map[0].size())));
+    int width = this->distance_map.getWidth();
+    int height = this->distance_map.getHeight();
+    this->recreated_img = std::move(ws.recreated_img);
+    this->recreated_img.reset(width, height);
+    BitMask &covered = ws.covered;
+    covered.reset(width, height);
 
-    for (int y = 0; y < this->distance_map.size(); y++)
+    if (this->options.distance_metric == EUCLIDEAN)
+    {
+        this->distance_map.visit([&](auto & dist) {
+            euclideanCoverage(dist, this->ridge_points, covered,
+                              ws.distance_scratch, this->options.threads);
+        });
+    }
+    else
     {
-        for (int x = 0; x < this->distance_map[y].size(); x++)
+        // -1 marks points that no ridge point reaches; the border is -1
+        // as well, so it never adds anything to the pixels next to it
+        Grid<int> &coverage = ws.coverage;
+        coverage.reset(width, height, -1, 1);
+        for (RidgePoint point : this->ridge_list)
         {
-            // checking if current point is part of the skeleton
-            if (this->ridge_points[y][x] != NONE)
+            coverage[point.y][point.x] = point.distance;
+        }
+
+        // start from top-left corner, carrying the remaining steps right and down
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
             {
-                // stores (x, y) with remaining steps d
-                queue<pair<pair<int, int>, int>> pixel_queue;
-                pixel_queue.push({{x, y}, this->distance_map[y][x]});
-
-                // setting the colour of the center of the circle
-                // sets STRONG pixels to green
-                if (this->ridge_points[y][x] == STRONG)
-                    this->recreated_img.setPixel(x, y, Pixel(0, 255, 0, 255));
-                // sets GOOD pixels to blue
-                else if (this->ridge_points[y][x] == GOOD)
-                    this->recreated_img.setPixel(x, y, Pixel(0, 0, 255, 255));
-                // sets WEAK pixels to red
-                else if (this->ridge_points[y][x] == WEAK)
-                    this->recreated_img.setPixel(x, y, Pixel(255, 0, 0, 255));
-
-                // colour in the circle centered at the current point with
-                // radius equal to the distance function at this point
-                while (!pixel_queue.empty())
-                {
-                    int currx, curry;
-                    int steps;
-                    pair<int, int> coordinates;
-                    tie(coordinates, steps) = pixel_queue.front();
-                    tie(currx, curry) = coordinates;
-                    pixel_queue.pop();
-                    if (visited[curry][currx][steps]) continue;
-                    visited[curry][currx][steps] = true;
-
-                    // if the pixel isn't set yet, set it to grey
-                    if (this->recreated_img.getPixel(currx, curry) == WHITEPIXEL)
-                    {
-                        this->recreated_img.setPixel(currx, curry, GREYPIXEL);
-                    }
-
-                    // if we still need to keep going, check in all four directions
-                    if (steps != 0)
-                    {
-                        if (isPixelValid(currx+1, curry, distance_map) &&
-                            !visited[curry][currx+1][steps-1])
-                        {
-                            pixel_queue.push({{currx+1, curry}, steps-1});
-                        }
-                        if (isPixelValid(currx, curry-1, distance_map) &&
-                            !visited[curry-1][currx][steps-1])
-                        {
-                            pixel_queue.push({{currx, curry-1}, steps-1});
-                        }
-                        if (isPixelValid(currx-1, curry, distance_map) &&
-                            !visited[curry][currx-1][steps-1])
-                        {
-                            pixel_queue.push({{currx-1, curry}, steps-1});
-                        }
-                        if (isPixelValid(currx, curry+1, distance_map) &&
-                            !visited[curry+1][currx][steps-1])
-                        {
-                            pixel_queue.push({{currx, curry+1}, steps-1});
-                        }
-                    }
-                }
+                coverage[y][x] = max(coverage[y][x], coverage[y][x-1] - 1);
+                coverage[y][x] = max(coverage[y][x], coverage[y-1][x] - 1);
+            }
+        }
+
+        // start from bottom-right corner, carrying the remaining steps left and up
+        for (int y = height-1; y >= 0; y--)
+        {
+            for (int x = width-1; x >= 0; x--)
+            {
+                coverage[y][x] = max(coverage[y][x], coverage[y][x+1] - 1);
+                coverage[y][x] = max(coverage[y][x], coverage[y+1][x] - 1);
+                if (coverage[y][x] >= 0) covered.set(x, y);
             }
         }
     }
+
+    // sets the covered pixels to grey
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (covered.get(x, y))
+                this->recreated_img.setPixel(x, y, GREYPIXEL);
+        }
+    }
+
+    // then colours the ridge points over them
+    for (RidgePoint point : this->ridge_list)
+    {
+        // sets STRONG pixels to green
+        if (point.type == STRONG)
+            this->recreated_img.setPixel(point.x, point.y, Pixel(0, 255, 0, 255));
+        // sets GOOD pixels to blue
+        else if (point.type == GOOD)
+            this->recreated_img.setPixel(point.x, point.y, Pixel(0, 0, 255, 255));
+        // sets WEAK pixels to red
+        else
+            this->recreated_img.setPixel(point.x, point.y, Pixel(255, 0, 0, 255));
+    }
+}
+
+/*
+    The require functions calculate an output and whatever it is calculated
+    from, unless that has been done already. Nothing is calculated for a
+    skeleton without an image. They calculate in the workspace from the
+    options, or in one of their own that is freed when they are done.
+*/
+
+/*
+    Makes sure the distance map is calculated.
+*/
+void Skeleton::requireDistanceMap ()
+{
+    if (this->has_distance_map || this->binary_img.empty()) return;
+    SkeletonWorkspace own;
+    calculateDistanceMap(this->options.workspace ? *this->options.workspace : own);
+    this->has_distance_map = true;
+}
+
+/*
+    Makes sure an output of the ridge pass is calculated: the grid of ridge
+    points, their list or the segment count. They are calculated together,
+    but each can be taken on its own, so this only calculates them again if
+    the one asked for is gone.
+
+    @param calculated Whether the output asked for is calculated
+*/
+void Skeleton::requireRidgePoints (bool calculated)
+{
+    if (calculated || this->binary_img.empty()) return;
+    requireDistanceMap();
+    SkeletonWorkspace own;
+    calculateRidgePoints(this->options.workspace ? *this->options.workspace : own);
+    this->has_ridge_points = true;
+    this->has_ridge_list = true;
+    this->has_segment_count = true;
+}
+
+/*
+    Makes sure the recreated image is calculated.
+*/
+void Skeleton::requireRecreatedImage ()
+{
+    if (this->has_recreated_img || this->binary_img.empty()) return;
+    requireDistanceMap();
+    requireRidgePoints(this->has_ridge_points && this->has_ridge_list);
+    SkeletonWorkspace own;
+    recreateImage(this->options.workspace ? *this->options.workspace : own);
+    this->has_recreated_img = true;
+}
+
+/*
+    Hands the buffers of the skeleton's image and outputs over to workspace,
+    to be reused by the next skeleton made with it. This leaves the skeleton
+    empty, so references from its getters must not be used after this.
+
+    @param workspace The workspace to give the buffers to
+*/
+void Skeleton::recycleInto (SkeletonWorkspace & workspace)
+{
+    workspace.binary_img = exchange(this->binary_img, BitMask());
+    workspace.distance_map = exchange(this->distance_map, DistanceMap());
+    workspace.ridge_points = exchange(this->ridge_points, Grid<int>());
+    workspace.ridge_list = exchange(this->ridge_list, vector<RidgePoint>());
+    workspace.recreated_img = exchange(this->recreated_img, PNG());
+    workspace.segments = exchange(this->segments, DisjointSet());
+    this->has_distance_map = false;
+    this->has_ridge_points = false;
+    this->has_ridge_list = false;
+    this->has_segment_count = false;
+    this->has_recreated_img = false;
+}
+
+/*
+    Returns a copy of options with the input policy set to policy.
+*/
+static SkeletonOptions withInputPolicy (SkeletonOptions options, inputPolicy policy)
+{
+    options.input_policy = policy;
+    return options;
 }
 
 /*
@@ -654,89 +806,229 @@ Skeleton::Skeleton (int width, int height)
         cout << __FUNCTION__ << ": ERROR could not initialize skeleton with width=" << width << " and height=" << height << endl;
         return;
     }
-    this->binary_img = vector<vector<int>>(height, vector<int>(width, 0));
-    this->distance_map = vector<vector<int>>(height, vector<int>(width, 0));
-    this->ridge_points = vector<vector<int>>(height, vector<int>(width, 0));
-    this->recreated_img = PNG(width, height);
+    this->binary_img = BitMask(width, height);
 }
 
 /*
     Constructor for a skeleton given a 2d vector of pixel values.
+    Like every constructor, this only stores the binary image; the distance
+    map, ridge points and recreated image are calculated when they are first
+    asked for.
 
     @param img The 2d vector representing a binary image, with
                values 0 and 1
+    @param options The settings for calculating the skeleton
 */
-Skeleton::Skeleton (vector<vector<int>> & img)
+Skeleton::Skeleton (vector<vector<int>> & img, SkeletonOptions options)
 {
+    this->options = options;
     if (img.size() == 0 || img[0].size() == 0)
     {
         cout << __FUNCTION__ << ": ERROR could not initialize skeleton with given image vector" << endl;
         return;
     }
-    this->binary_img = img;
-    this->distance_map = vector<vector<int>>(img.size(), vector<int>(img[0].size(), 0));
-    this->ridge_points = vector<vector<int>>(img.size(), vector<int>(img[0].size(), 0));
-    this->recreated_img = PNG(img[0].size(), img.size());
-    // cout << "recreated image size: " << this->recreated_img.getWidth() << " " << this->recreated_img.getHeight() << endl;
-
-    calculateDistanceMap();
-    calculateRidgePoints();
-    recreateImage();
+    int width = img[0].size();
+    int height = img.size();
+    if (options.workspace)
+        this->binary_img = std::move(options.workspace->binary_img);
+    this->binary_img.reset(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (img[y][x]) this->binary_img.set(x, y);
+        }
+    }
 }
 
 /*
     Constructor for a skeleton given a png image.
+    Only the binarized image is needed once the constructor is done, so by
+    default nothing of img is kept; options.input_policy can ask for the
+    skeleton to borrow it or keep a copy instead (see getInputImage).
 
     @param img The binary png image
+    @param options The settings for calculating the skeleton
 */
-Skeleton::Skeleton (PNG & img)
+Skeleton::Skeleton (const PNG & img, SkeletonOptions options)
 {
+    this->options = options;
     if (img.getWidth() == 0 || img.getHeight() == 0)
     {
         cout << __FUNCTION__ << ": ERROR could not initialize skeleton with given image" << endl;
         return;
     }
-    this->img = img;
-    this->binary_img = vector<vector<int>>(img.getHeight(), vector<int>(img.getWidth(), 0));
+    if (options.input_policy == KEEP_INPUT)
+        this->img = img;
+    else if (options.input_policy == BORROW_INPUT)
+        this->borrowed_img = &img;
+    if (options.workspace)
+        this->binary_img = std::move(options.workspace->binary_img);
+    this->binary_img.reset(img.getWidth(), img.getHeight());
     getBinaryImage (img);
-    this->distance_map = vector<vector<int>>(img.getHeight(), vector<int>(img.getWidth(), 0));
-    this->ridge_points = vector<vector<int>>(img.getHeight(), vector<int>(img.getWidth(), 0));
-    this->recreated_img = PNG(img.getWidth(), img.getHeight());
+}
+
+/*
+    Constructor for a skeleton given a png image the caller is done with.
+    With KEEP_INPUT the image is moved into the skeleton rather than copied.
+    A temporary can't be borrowed, so BORROW_INPUT keeps it the same way.
+
+    @param img The binary png image
+    @param options The settings for calculating the skeleton
+*/
+Skeleton::Skeleton (PNG && img, SkeletonOptions options)
+    : Skeleton(img, withInputPolicy(options, DROP_INPUT))
+{
+    if (options.input_policy != DROP_INPUT)
+    {
+        this->img = std::move(img);
+        this->options.input_policy = KEEP_INPUT;
+    }
+}
 
-    calculateDistanceMap();
-    calculateRidgePoints();
-    recreateImage();
+/*
+    Returns the image the skeleton was made from, or NULL if it was not made
+    from a PNG or the input policy was DROP_INPUT. A borrowed image is only
+    valid while the caller keeps it alive.
+
+    @return the input image, or NULL
+*/
+const PNG * Skeleton::getInputImage () const
+{
+    if (this->options.input_policy == KEEP_INPUT && this->img.getWidth() > 0)
+        return &this->img;
+    if (this->options.input_policy == BORROW_INPUT)
+        return this->borrowed_img;
+    return NULL;
 }
 
 /*
-    Returns the distance map.
-    (does not calculate the distance values)
+    Returns the binarized image the outputs are calculated from. It is made
+    by the constructor, so this never calculates anything.
+
+    @return the binary image, empty if the skeleton has no image
+*/
+const BitMask & Skeleton::getMask () const
+{
+    return this->binary_img;
+}
+
+/*
+    Returns the distance map, calculating it on the first call. The reference
+    stays valid until the skeleton is changed or destroyed.
 
     @return the distance map of the skeleton
 */
-vector<vector<int>> Skeleton::getDistanceMap ()
+const DistanceMap & Skeleton::getDistanceMap ()
 {
+    requireDistanceMap();
     return this->distance_map;
 }
 
 /*
-    Returns a vector with the ridge points as non-zero values.
-    (does not calculate the ridge points)
+    Returns a grid with the ridge points as non-zero values, calculating them
+    on the first call. The reference stays valid until the skeleton is
+    changed or destroyed.
 
-    @return vector with ridge points as non-zero values
+    @return grid with ridge points as non-zero values
 */
-vector<vector<int>> Skeleton::getRidgePoints ()
+const Grid<int> & Skeleton::getRidgePoints ()
 {
+    requireRidgePoints(this->has_ridge_points);
     return this->ridge_points;
 }
 
 /*
-    Returns the recreated image.
-    (does not calculate the recreated image)
+    Returns the points of the skeleton in raster order (by row, then by
+    column), with their distance values and labels. This is the skeleton
+    without the rest of the image around it. The ridge points are calculated
+    on the first call. The reference stays valid until the skeleton is
+    changed or destroyed.
+
+    @return the list of ridge points
+*/
+const vector<RidgePoint> & Skeleton::getRidgePointList ()
+{
+    requireRidgePoints(this->has_ridge_list);
+    return this->ridge_list;
+}
+
+/*
+    Returns the number of separate (8-connected) segments the skeleton is in
+    after linking; 1 means the skeleton is in one piece. The ridge points are
+    calculated on the first call.
+
+    @return the number of skeleton segments
+*/
+int Skeleton::getSegmentCount ()
+{
+    requireRidgePoints(this->has_segment_count);
+    return this->segments.count();
+}
+
+/*
+    Returns the recreated image, calculating it on the first call. The
+    reference stays valid until the skeleton is changed or destroyed.
 
     @return the recreated image as a png
 */
-PNG Skeleton::getRecreatedImage ()
+const PNG & Skeleton::getRecreatedImage ()
 {
+    requireRecreatedImage();
     return this->recreated_img;
 }
+
+/*
+    The take functions hand a result over to the caller without copying it,
+    calculating it first if needed. The result is then gone from the skeleton;
+    if it is asked for again, or another output needs it, it is calculated
+    again.
+*/
+
+/*
+    Moves the distance map out of the skeleton.
+
+    @return the distance map of the skeleton
+*/
+DistanceMap Skeleton::takeDistanceMap ()
+{
+    requireDistanceMap();
+    this->has_distance_map = false;
+    return exchange(this->distance_map, DistanceMap());
+}
+
+/*
+    Moves the grid of ridge points out of the skeleton.
+
+    @return grid with ridge points as non-zero values
+*/
+Grid<int> Skeleton::takeRidgePoints ()
+{
+    requireRidgePoints(this->has_ridge_points);
+    this->has_ridge_points = false;
+    return exchange(this->ridge_points, Grid<int>());
+}
+
+/*
+    Moves the list of ridge points out of the skeleton.
+
+    @return the list of ridge points
+*/
+vector<RidgePoint> Skeleton::takeRidgePointList ()
+{
+    requireRidgePoints(this->has_ridge_list);
+    this->has_ridge_list = false;
+    return exchange(this->ridge_list, vector<RidgePoint>());
+}
+
+/*
+    Moves the recreated image out of the skeleton.
+
+    @return the recreated image as a png
+*/
+PNG Skeleton::takeRecreatedImage ()
+{
+    requireRecreatedImage();
+    this->has_recreated_img = false;
+    return exchange(this->recreated_img, PNG());
+}
@@ -3,65 +3,183 @@
 
 #include <vector>
 #include "PNG.h"
+#include "grid.h"
+#include "distancemap.h"
+#include "distance.h"
+#include "bitmask.h"
+#include "candidates.h"
+#include "disjointset.h"
 
 using namespace std;
 
-// labels for the candidate ridge points
-enum prominency {
-    NONE,
-    WEAK,
-    GOOD,
-    STRONG
+// distance metrics for the distance map
+enum metric {
+    MANHATTAN, // city-block distance to the border
+    EUCLIDEAN  // squared straight-line distance to the border
+};
+
+// what a skeleton made from a PNG does with it once it is binarized
+enum inputPolicy {
+    DROP_INPUT,   // keep nothing of it
+    BORROW_INPUT, // remember where it is; the caller keeps it alive
+    KEEP_INPUT    // keep a copy (or the PNG itself if it is moved in)
+};
+
+class SkeletonWorkspace;
+
+// settings for how a skeleton is calculated
+struct SkeletonOptions {
+    metric distance_metric = MANHATTAN;
+    inputPolicy input_policy = DROP_INPUT;
+    int threads = 1; // threads used by the distance transforms (see
+                     // --transform-threads); the results are the same for
+                     // any count
+    bool stop_when_connected = false; // only keep branches that link two
+                                      // skeleton segments, and stop linking
+                                      // once there is only one; as dropped
+                                      // branches start no others, this can
+                                      // leave more segments than keeping
+                                      // every branch does
+    SkeletonWorkspace * workspace = NULL; // buffers to calculate in, or NULL
+                                          // to allocate them for this skeleton
+};
+
+// a point on the skeleton
+struct RidgePoint {
+    int x;
+    int y;
+    int distance;    // the point's value in the distance map
+    prominency type; // STRONG, GOOD or WEAK
+};
+
+/*
+    The buffers a skeleton is calculated in, kept from one skeleton to the
+    next so that a stream of images can be skeletonized without allocating.
+    Every buffer grows to the largest image seen and is then reused.
+
+    A skeleton made with the workspace in its options uses its scratch
+    buffers while it calculates, and starts its outputs from the buffers
+    that Skeleton::recycleInto handed back from an earlier skeleton. Only one
+    skeleton may be calculating in a workspace at a time.
+*/
+class SkeletonWorkspace {
+private:
+    friend class Skeleton;
+
+    // scratch space
+    Grid<int> window;             // distance map rows being labelled
+    Grid<prominency> ridge_prominency;
+    Grid<char> visited;
+    vector<pair<int,int>> chosen;
+    vector<pair<int,int>> endpoints;
+    vector<long long> worklist;
+    vector<pair<int,int>> tentative;
+    Grid<int> segment_ids;
+    Grid<int> coverage;
+    BitMask covered;
+    DistanceScratch distance_scratch; // the distance transforms' buffers
+
+    // outputs of recycled skeletons
+    BitMask binary_img;
+    DistanceMap distance_map;
+    Grid<int> ridge_points;
+    vector<RidgePoint> ridge_list;
+    PNG recreated_img;
+    DisjointSet segments;
 };
 
 class Skeleton {
 private:
-    PNG img;
-    vector<vector<int>> binary_img;
-    vector<vector<int>> distance_map;
-    vector<vector<int>> ridge_points;
+    PNG img;                         // the input, with KEEP_INPUT
+    const PNG * borrowed_img = NULL; // the input, with BORROW_INPUT
+    BitMask binary_img;
+    DistanceMap distance_map;
+    Grid<int> ridge_points;
+    vector<RidgePoint> ridge_list; // the points of ridge_points, in raster order
     PNG recreated_img;
+    SkeletonOptions options;
+    DisjointSet segments;  // connected parts of the skeleton
+    Grid<int> segment_ids; // skeleton point -> segment element, -1 elsewhere
+
+    // which outputs are calculated; each is done on first access
+    bool has_distance_map = false;
+    bool has_ridge_points = false;
+    bool has_ridge_list = false;
+    bool has_segment_count = false;
+    bool has_recreated_img = false;
+
+    void getBinaryImage (const PNG & img);
 
-    bool isPixelValid (int x, int y, vector<vector<int>> & v);
+    void calculateDistanceMap (SkeletonWorkspace &ws);
 
-    int getPixelDistance (int x, int y);
+    void labelCandidates (Grid<prominency> &ridge_prominency, Grid<int> &window);
 
-    void setPixelDistance (int x, int y, int distVal);
+    void ridgePointsFirstPass (Grid<prominency> &ridge_prominency,
+                               Grid<char> &visited,
+                               vector<pair<int,int>> &endpoints,
+                               vector<pair<int,int>> &chosen);
 
-    void getBinaryImage (PNG & img);
+    int countRidgeNeighbours (int x, int y, int &dx, int &dy);
 
-    void calculateDistanceMap ();
+    void joinSegments (int x, int y);
 
-    void calculateScanMap (vector<vector<int>> &scanX, vector<vector<int>> &scanY);
+    bool branchLinksSegments (int x, int y, vector<pair<int,int>> &tentative);
 
-    void labelCandidates (vector<vector<int>> &scanX,
-                          vector<vector<int>> &scanY,
-                          vector<vector<prominency>> &ridge_prominency);
+    bool extendBranch (int x, int y, int dx, int dy,
+                       Grid<prominency> &ridge_prominency,
+                       Grid<char> &visited,
+                       vector<pair<int,int>> &tentative);
 
-    void ridgePointsFirstPass (vector<vector<prominency>> &ridge_prominency,
-                               vector<vector<bool>> &visited);
+    void ridgePointsSecondPass (Grid<prominency> &ridge_prominency,
+                                Grid<char> &visited,
+                                vector<pair<int,int>> &endpoints,
+                                vector<long long> &worklist,
+                                vector<pair<int,int>> &tentative);
 
-    void ridgePointsSecondPass (vector<vector<prominency>> &ridge_prominency,
-                                vector<vector<bool>> &visited);
+    void calculateRidgePoints (SkeletonWorkspace &ws);
 
-    void calculateRidgePoints ();
+    void recreateImage (SkeletonWorkspace &ws);
 
-    void recreateImage ();
+    void requireDistanceMap ();
+
+    void requireRidgePoints (bool calculated);
+
+    void requireRecreatedImage ();
 
 public:
     Skeleton ();
 
     Skeleton (int width, int height);
 
-    Skeleton (vector<vector<int>> & img);
+    Skeleton (vector<vector<int>> & img, SkeletonOptions options = SkeletonOptions());
+
+    Skeleton (const PNG & img, SkeletonOptions options = SkeletonOptions());
+
+    Skeleton (PNG && img, SkeletonOptions options = SkeletonOptions());
+
+    const PNG * getInputImage () const;
+
+    const BitMask & getMask () const;
+
+    const DistanceMap & getDistanceMap ();
+
+    const Grid<int> & getRidgePoints ();
+
+    const vector<RidgePoint> & getRidgePointList ();
+
+    int getSegmentCount ();
+
+    const PNG & getRecreatedImage ();
+
+    DistanceMap takeDistanceMap ();
 
-    Skeleton (PNG & img);
+    Grid<int> takeRidgePoints ();
 
-    vector<vector<int>> getDistanceMap ();
+    vector<RidgePoint> takeRidgePointList ();
 
-    vector<vector<int>> getRidgePoints ();
+    PNG takeRecreatedImage ();
 
-    PNG getRecreatedImage ();
+    void recycleInto (SkeletonWorkspace & workspace);
 
 };
 
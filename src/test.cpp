@@ -1,7 +1,25 @@
 #include <iostream>
 #include <vector>
+#include <deque>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <unistd.h>
 #include "PNG.h"
 #include "skeleton.h"
+#include "cache.h"
+#include "server.h"
+#include "batch.h"
+#include "boundedqueue.h"
 
 #define WHITEPIXEL Pixel(255, 255, 255, 255)
 
@@ -35,16 +53,10 @@ void solveProblem() {
     }
 
     skeleton = Skeleton(img);
-    vector<vector<int>> ridge_points = skeleton.getRidgePoints();
-    vector<vector<int>> distance_map = skeleton.getDistanceMap();
     vector<data_tuple> tuples;
-    for (int y = 0; y < L; y++) {
-        for (int x = 0; x < W; x++) {
-            if (ridge_points[y][x]) {
-                data_tuple t = {x, y, distance_map[y][x]};
-                tuples.push_back(t);
-            }
-        }
+    for (RidgePoint p : skeleton.getRidgePointList()) {
+        data_tuple t = {p.x, p.y, p.distance};
+        tuples.push_back(t);
     }
     cout << tuples.size() << endl;
     for (data_tuple t : tuples) {
@@ -54,14 +66,1503 @@ void solveProblem() {
 }
 
 /*
-    Driver for taking in test cases and verifying the output.
+    Returns a width x height image of 0s with a filled rectangle in it.
+*/
+vector<vector<int>> rectangleImage(int width, int height, int x0, int y0, int x1, int y1) {
+    vector<vector<int>> image(height, vector<int>(width, 0));
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            image[y][x] = 1;
+        }
+    }
+    return image;
+}
+
+/*
+    Returns a width x height image of random 0s and 1s, about density
+    percent of them 1s.
+*/
+vector<vector<int>> randomImage(int width, int height, int density) {
+    vector<vector<int>> image(height, vector<int>(width, 0));
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            image[y][x] = rand() % 100 < density;
+        }
+    }
+    return image;
+}
+
+/*
+    Reference Manhattan distance transform: a breadth-first search out from
+    the 0 pixels and the pixels around the image.
+*/
+vector<vector<int>> bfsManhattan(const vector<vector<int>> & image) {
+    int height = image.size();
+    int width = image[0].size();
+    vector<vector<int>> dist(height, vector<int>(width, -1));
+    deque<pair<int,int>> queue;
+    // the 0 pixels go in before the 1s on the edge, so the queue stays in
+    // order of distance
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!image[y][x]) {
+                dist[y][x] = 0;
+                queue.push_back({x, y});
+            }
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (image[y][x] && (x == 0 || y == 0 || x == width-1 || y == height-1)) {
+                dist[y][x] = 1;
+                queue.push_back({x, y});
+            }
+        }
+    }
+    while (!queue.empty()) {
+        pair<int,int> p = queue.front();
+        queue.pop_front();
+        int dx[] = {1, -1, 0, 0};
+        int dy[] = {0, 0, 1, -1};
+        for (int i = 0; i < 4; i++) {
+            int nx = p.first + dx[i];
+            int ny = p.second + dy[i];
+            if (nx < 0 || ny < 0 || nx >= width || ny >= height || dist[ny][nx] >= 0) continue;
+            dist[ny][nx] = dist[p.second][p.first] + 1;
+            queue.push_back({nx, ny});
+        }
+    }
+    return dist;
+}
+
+/*
+    Reference Euclidean distance transform: the squared distance from every
+    1 pixel to the nearest 0 pixel or pixel around the image, trying every
+    row that could be nearer than the nearest side.
+*/
+vector<vector<long long>> bruteEuclidean(const vector<vector<int>> & image) {
+    int height = image.size();
+    int width = image[0].size();
+
+    // the horizontal distance to the nearest 0 in the same row, or -1
+    vector<vector<int>> nearest(height, vector<int>(width, -1));
+    for (int y = 0; y < height; y++) {
+        int last = -1;
+        for (int x = 0; x < width; x++) {
+            if (!image[y][x]) last = x;
+            if (last >= 0) nearest[y][x] = x - last;
+        }
+        last = -1;
+        for (int x = width-1; x >= 0; x--) {
+            if (!image[y][x]) last = x;
+            if (last >= 0 && (nearest[y][x] < 0 || last - x < nearest[y][x]))
+                nearest[y][x] = last - x;
+        }
+    }
+
+    vector<vector<long long>> dist(height, vector<long long>(width, 0));
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!image[y][x]) continue;
+            long long side = min(min(x + 1, width - x), min(y + 1, height - y));
+            long long best = side * side;
+            for (int dy = 0; (long long)dy * dy < best; dy++) {
+                for (int ny : {y - dy, y + dy}) {
+                    if (ny < 0 || ny >= height || nearest[ny][x] < 0) continue;
+                    long long dx = nearest[ny][x];
+                    best = min(best, dx * dx + (long long)dy * dy);
+                }
+            }
+            dist[y][x] = best;
+        }
+    }
+    return dist;
+}
+
+/*
+    Checks the distance map of a skeleton against a reference.
+
+    @param name What is being checked, for the message
+    @param distance_map The distance map
+    @param expected The reference distances
+    @param cellBytes The cell width the map should have, or 0 for any
+    @return Whether they match
+*/
+template <typename T>
+bool checkDistanceMap(const string & name, const DistanceMap & distance_map,
+                      const vector<vector<T>> & expected, int cellBytes) {
+    if (cellBytes && distance_map.getCellBytes() != cellBytes) {
+        cout << "WRONG ANSWER: " << name << " has " << distance_map.getCellBytes()
+             << " byte cells where should be " << cellBytes << endl;
+        return false;
+    }
+    for (int y = 0; y < (int)expected.size(); y++) {
+        for (int x = 0; x < (int)expected[y].size(); x++) {
+            if ((T)distance_map[y][x] != expected[y][x]) {
+                cout << "WRONG ANSWER: " << name << " " << distance_map[y][x] << " at ("
+                     << x << "," << y << ") where should be " << expected[y][x] << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    Checks the Manhattan distance map of an image against the reference,
+    with one thread and with several.
+*/
+bool checkManhattan(const string & name, vector<vector<int>> image, int cellBytes = 0) {
+    vector<vector<int>> expected = bfsManhattan(image);
+    for (int threads : {1, 3}) {
+        SkeletonOptions options;
+        options.threads = threads;
+        Skeleton skeleton(image, options);
+        if (!checkDistanceMap(name, skeleton.getDistanceMap(), expected, cellBytes))
+            return false;
+    }
+    return true;
+}
+
+/*
+    Checks the Euclidean distance map of an image against the reference, and
+    that the recreated image covers exactly the pixels strictly inside the
+    disc of some ridge point, with one thread and with several.
+*/
+bool checkEuclidean(const string & name, vector<vector<int>> image, int cellBytes = 0) {
+    vector<vector<long long>> expected = bruteEuclidean(image);
+    int height = image.size();
+    int width = image[0].size();
+    for (int threads : {1, 3}) {
+        SkeletonOptions options;
+        options.threads = threads;
+        options.distance_metric = EUCLIDEAN;
+        Skeleton skeleton(image, options);
+        const DistanceMap & distance_map = skeleton.getDistanceMap();
+        if (!checkDistanceMap(name, distance_map, expected, cellBytes))
+            return false;
+
+        // the ridge points are drawn whether their discs cover them or not,
+        // as the ones that join segments can lie on 0 pixels
+        vector<vector<int>> covered(height, vector<int>(width, 0));
+        for (RidgePoint p : skeleton.getRidgePointList()) {
+            long long radius = distance_map[p.y][p.x];
+            covered[p.y][p.x] = 1;
+            for (int y = max(0, p.y - (int)radius); y <= min(height-1, p.y + (int)radius); y++) {
+                for (int x = max(0, p.x - (int)radius); x <= min(width-1, p.x + (int)radius); x++) {
+                    long long dx = x - p.x;
+                    long long dy = y - p.y;
+                    if (dx * dx + dy * dy < radius) covered[y][x] = 1;
+                }
+            }
+        }
+        const PNG & recreated = skeleton.getRecreatedImage();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if ((recreated.getPixel(x, y) != WHITEPIXEL) != (bool)covered[y][x]) {
+                    cout << "WRONG ANSWER: " << name << " coverage at (" << x << ","
+                         << y << ") where should be " << covered[y][x] << endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    Checks the distance transforms against references, including images
+    whose columns are longer than the cells of their distance maps can count.
+*/
+/*
+    Checks a distance transform run straight into a map of the given cell
+    width, on a mask that is all set, so the columns are as long as the
+    image is tall, however much that is more than the cells hold.
+
+    @param name What is being checked, for the message
+    @param width The width of the mask
+    @param height The height of the mask
+    @param maxValue The largest value the map is made to hold
+    @param distance_metric Which transform to run
+*/
+bool checkNarrowCells(const string & name, int width, int height, long long maxValue,
+                      metric distance_metric) {
+    BitMask mask;
+    mask.reset(width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) mask.set(x, y);
+    }
+    bool ok = true;
+    for (int threads : {1, 3}) {
+        DistanceMap distance_map;
+        DistanceScratch scratch;
+        distance_map.reset(width, height, maxValue, 1);
+        distance_map.visit([&](auto & dist) {
+            if (distance_metric == EUCLIDEAN) euclideanDistance(mask, dist, scratch, threads);
+            else manhattanDistance(mask, dist, scratch, threads);
+        });
+        for (int y = 0; ok && y < height; y++) {
+            for (int x = 0; ok && x < width; x++) {
+                long long side = min(min(x + 1, width - x), min(y + 1, height - y));
+                long long expected = distance_metric == EUCLIDEAN ? side * side : side;
+                if (distance_map[y][x] == expected) continue;
+                cout << "WRONG ANSWER: " << name << " " << distance_map[y][x] << " at (" << x
+                     << "," << y << ") where should be " << expected << endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+int testDistance() {
+    bool ok = true;
+    srand(1);
+
+    // a column run of 300 with 8-bit cells
+    vector<vector<int>> square = rectangleImage(400, 400, 50, 50, 350, 350);
+    ok = checkManhattan("square", square, 1) && ok;
+    Skeleton skeleton(square);
+    if (skeleton.getRidgePointList().size() != 604) {
+        cout << "WRONG ANSWER: square has " << skeleton.getRidgePointList().size()
+             << " ridge points where should be 604" << endl;
+        ok = false;
+    }
+
+    // the cells are as wide as the narrower side needs, however long the
+    // columns are
+    ok = checkManhattan("tall 8-bit", rectangleImage(3, 500, 0, 0, 3, 500), 1) && ok;
+    ok = checkManhattan("taller 8-bit", rectangleImage(2, 70000, 0, 0, 2, 70000), 1) && ok;
+    ok = checkManhattan("wide 8-bit", rectangleImage(70000, 2, 0, 0, 70000, 2), 1) && ok;
+    ok = checkManhattan("square 16-bit", rectangleImage(600, 600, 0, 0, 600, 600), 2) && ok;
+
+    // columns longer than the cells count, down to ones the kernels clamp
+    ok = checkNarrowCells("8-bit cells", 7, 600, 255, MANHATTAN) && ok;
+    ok = checkNarrowCells("16-bit cells", 5, 70000, 65535, MANHATTAN) && ok;
+    ok = checkNarrowCells("euclidean 8-bit cells", 29, 600, 255, EUCLIDEAN) && ok;
+    ok = checkNarrowCells("euclidean 16-bit cells", 5, 70000, 65535, EUCLIDEAN) && ok;
+
+    for (int i = 0; i < 40; i++) {
+        int width = 1 + rand() % 90;
+        int height = 1 + rand() % 90;
+        ok = checkManhattan("random " + to_string(width) + "x" + to_string(height),
+                            randomImage(width, height, 50 + rand() % 50)) && ok;
+    }
+
+    // tall and thin masks, whose columns are longer than their cells count
+    ok = checkEuclidean("euclidean square", rectangleImage(120, 120, 10, 10, 110, 110), 2) && ok;
+    ok = checkEuclidean("euclidean 8-bit", rectangleImage(5, 473, 0, 0, 5, 473), 1) && ok;
+    ok = checkEuclidean("euclidean taller 8-bit", rectangleImage(5, 70000, 0, 0, 5, 70000), 1) && ok;
+    ok = checkEuclidean("euclidean wide 8-bit", rectangleImage(473, 5, 0, 0, 473, 5), 1) && ok;
+    ok = checkEuclidean("euclidean column", rectangleImage(1, 300, 0, 0, 1, 300)) && ok;
+    ok = checkEuclidean("euclidean row", rectangleImage(300, 1, 0, 0, 300, 1)) && ok;
+
+    for (int i = 0; i < 40; i++) {
+        int width = 1 + rand() % 90;
+        int height = 1 + rand() % 90;
+        ok = checkEuclidean("euclidean random " + to_string(width) + "x" + to_string(height),
+                            randomImage(width, height, 50 + rand() % 50)) && ok;
+    }
+
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+/*
+    Checks that outputs read back from a cache are the ones of a skeleton.
+*/
+bool sameOutputs(Skeleton & skeleton, const CachedSkeleton & cached) {
+    const DistanceMap & distance_map = skeleton.getDistanceMap();
+    const vector<RidgePoint> & ridge_list = skeleton.getRidgePointList();
+    const PNG & recreated = skeleton.getRecreatedImage();
+    int width = distance_map.getWidth();
+    int height = distance_map.getHeight();
+    if (cached.getWidth() != width || cached.getHeight() != height ||
+        cached.getDistanceBytes() != distance_map.getCellBytes() ||
+        cached.getRidgePointCount() != ridge_list.size() ||
+        cached.getSegmentCount() != skeleton.getSegmentCount())
+        return false;
+
+    size_t rowBytes = (size_t)width * distance_map.getCellBytes();
+    const unsigned char * cells = (const unsigned char *)cached.getDistanceCells();
+    for (int y = 0; y < height; y++) {
+        if (memcmp(distance_map.rowData(y), cells + y * rowBytes, rowBytes) != 0)
+            return false;
+    }
+    for (size_t i = 0; i < ridge_list.size(); i++) {
+        RidgePoint a = ridge_list[i];
+        RidgePoint b = cached.getRidgePointList()[i];
+        if (a.x != b.x || a.y != b.y || a.distance != b.distance || a.type != b.type)
+            return false;
+    }
+    return memcmp(recreated.getRawData(), cached.getRecreatedData(),
+                  (size_t)width * height * 4) == 0;
+}
+
+/*
+    Changes the byte at offset in a file.
+*/
+void corruptByte(const string & path, size_t offset) {
+    fstream file(path, ios::in | ios::out | ios::binary);
+    file.seekg(offset);
+    char byte = file.get();
+    file.seekp(offset);
+    file.put(byte ^ 1);
+}
+
+/*
+    Checks the result cache: outputs stored and found again are those of the
+    skeleton, a change of options that changes the outputs is a miss, and
+    files that are truncated or corrupted are not used.
+*/
+int testCache() {
+    bool ok = true;
+    srand(2);
+    filesystem::path directory = filesystem::temp_directory_path() /
+                                 ("skeleton_cache_test_" + to_string(getpid()));
+    filesystem::remove_all(directory);
+    ResultCache cache(directory.string());
+
+    vector<vector<int>> image = randomImage(70, 50, 80);
+    SkeletonOptions options;
+    Skeleton skeleton(image, options);
+    if (cache.find(skeleton.getMask(), options)) {
+        cout << "WRONG ANSWER: cache hit before anything is stored" << endl;
+        ok = false;
+    }
+    if (!cache.store(skeleton, options)) {
+        cout << "WRONG ANSWER: could not store in the cache" << endl;
+        return 1;
+    }
+
+    // the round trip, and options that do not change the outputs
+    SkeletonOptions threaded = options;
+    threaded.threads = 3;
+    for (const SkeletonOptions & o : {options, threaded}) {
+        shared_ptr<CachedSkeleton> cached = cache.find(skeleton.getMask(), o);
+        if (!cached || !sameOutputs(skeleton, *cached)) {
+            cout << "WRONG ANSWER: cached outputs are not the skeleton's" << endl;
+            ok = false;
+        }
+    }
+
+    // options that change the outputs, and another mask
+    SkeletonOptions euclidean = options;
+    euclidean.distance_metric = EUCLIDEAN;
+    SkeletonOptions connected = options;
+    connected.stop_when_connected = true;
+    if (cache.find(skeleton.getMask(), euclidean) || cache.find(skeleton.getMask(), connected)) {
+        cout << "WRONG ANSWER: cache hit for other options" << endl;
+        ok = false;
+    }
+    vector<vector<int>> other = image;
+    other[10][10] = !other[10][10];
+    if (cache.find(Skeleton(other).getMask(), options)) {
+        cout << "WRONG ANSWER: cache hit for another mask" << endl;
+        ok = false;
+    }
+
+    // the file of the entry, which is the only one in the directory
+    string path;
+    for (const filesystem::directory_entry & entry : filesystem::directory_iterator(directory))
+        path = entry.path().string();
+    size_t size = filesystem::file_size(path);
+    string stored;
+    {
+        ifstream file(path, ios::binary);
+        stored.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+    auto restore = [&]() {
+        ofstream file(path, ios::binary | ios::trunc);
+        file << stored;
+    };
+
+    // the header is 88 bytes (the width at 16), then the mask
+    struct { const char * name; size_t offset; } corruptions[] = {
+        {"magic", 0}, {"version", 8}, {"width", 16}, {"offset", 56}, {"mask", 88}
+    };
+    for (auto corruption : corruptions) {
+        corruptByte(path, corruption.offset);
+        if (cache.find(skeleton.getMask(), options)) {
+            cout << "WRONG ANSWER: cache hit with corrupted " << corruption.name << endl;
+            ok = false;
+        }
+        restore();
+    }
+    for (size_t length : {(size_t)40, size / 2, size - 1}) {
+        filesystem::resize_file(path, length);
+        if (cache.find(skeleton.getMask(), options)) {
+            cout << "WRONG ANSWER: cache hit with a file of " << length << " of "
+                 << size << " bytes" << endl;
+            ok = false;
+        }
+        restore();
+    }
+    if (!cache.find(skeleton.getMask(), options)) {
+        cout << "WRONG ANSWER: cache miss after restoring the file" << endl;
+        ok = false;
+    }
+
+    filesystem::remove_all(directory);
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+/*
+    Returns the contents of a file, or "" if it cannot be read.
+*/
+string readFile(const string & path) {
+    ifstream file(path, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+/*
+    Writes a string to a file.
+*/
+void writeFile(const string & path, const string & data) {
+    ofstream file(path, ios::binary | ios::trunc);
+    file << data;
+}
+
+/*
+    Runs a server on a string of requests and returns its replies.
+
+    @param requests The requests, as a client would send them
+    @param root The root directory of the server, or empty
+*/
+string serve(const string & requests, const string & root = "") {
+    BatchOptions options;
+    char * buffer = NULL;
+    size_t size = 0;
+    FILE * in = fmemopen((void *)requests.data(), requests.size(), "r");
+    FILE * out = open_memstream(&buffer, &size);
+    serveStream(options, in, out, root);
+    fclose(in);
+    string replies(buffer, size);
+    free(buffer);
+    return replies;
+}
+
+/*
+    Splits the replies of a server into the first line of each, by request
+    id, checking that every OK reply has the sections it says it has.
+
+    @param replies The replies
+    @param sections Set to the sections of each OK reply, by id and name
+    @return the first line of each reply, by id
+*/
+map<string, string> replyLines(const string & replies,
+                               map<string, map<string, string>> & sections) {
+    map<string, string> lines;
+    size_t at = 0;
+    while (at < replies.size()) {
+        size_t end = replies.find('\n', at);
+        if (end == string::npos) break;
+        string line = replies.substr(at, end - at);
+        at = end + 1;
+        istringstream fields(line);
+        string status, id;
+        int count = 0;
+        fields >> status >> id;
+        lines[id] = line;
+        if (status != "OK" || !(fields >> count)) continue;
+        for (int i = 0; i < count; i++) {
+            end = replies.find('\n', at);
+            if (end == string::npos) return lines;
+            istringstream header(replies.substr(at, end - at));
+            string name;
+            size_t length = 0;
+            header >> name >> length;
+            at = end + 1;
+            sections[id][name] = replies.substr(at, length);
+            at += length;
+        }
+    }
+    return lines;
+}
+
+/*
+    Checks that the reply to a request starts with a status.
+*/
+bool checkReply(map<string, string> & lines, const string & id, const string & status) {
+    if (lines[id].compare(0, status.size() + 1 + id.size(), status + " " + id) == 0)
+        return true;
+    cout << "WRONG ANSWER: request " << id << " got '" << lines[id] << "' where should be "
+         << status << endl;
+    return false;
+}
+
+/*
+    Checks the server: the framing of inline data and of the outputs sent
+    back, the errors for malformed, oversized and incomplete requests, and
+    that with a root directory no file
+    outside it is read or written, whether the path leads out through .. or
+    through a symbolic link, including one at a name an output is given by
+    adding to the output path.
+*/
+int testServer() {
+    bool ok = true;
+    filesystem::path directory = filesystem::temp_directory_path() /
+                                 ("skeleton_server_test_" + to_string(getpid()));
+    filesystem::remove_all(directory);
+    filesystem::path root = directory / "root";
+    filesystem::path outside = directory / "outside";
+    filesystem::create_directories(root);
+    filesystem::create_directories(outside);
+    filesystem::copy_file("../images/rectangle.png", root / "in.png");
+    filesystem::copy_file("../images/rectangle.png", outside / "secret.png");
+    writeFile((outside / "victim.png").string(), "victim");
+    writeFile((outside / "victim_ridge.txt").string(), "victim");
+    filesystem::create_symlink(outside / "victim.png", root / "o.png");
+    filesystem::create_symlink(outside / "victim_ridge.txt", root / "o_ridge.txt");
+    filesystem::create_symlink(outside, root / "escape");
+    filesystem::create_symlink(outside / "secret.png", root / "link.png");
+
+    string requests =
+        "a recreated,ridge in.png o\n"
+        "b ridge in.png out\n"
+        "c ridge ../outside/secret.png\n"
+        "d ridge escape/secret.png\n"
+        "e ridge link.png\n"
+        "f ridge " + (root / "in.png").string() + "\n"
+        "g ridge " + (outside / "secret.png").string() + "\n"
+        "h ridge in.png escape/made\n"
+        "i ridge in.png ../outside/made\n";
+    map<string, map<string, string>> sections;
+    map<string, string> lines = replyLines(serve(requests, root.string()), sections);
+    ok = checkReply(lines, "a", "ERROR") && ok;
+    ok = checkReply(lines, "b", "OK") && ok;
+    for (string id : {"c", "d", "e", "g", "h", "i"})
+        ok = checkReply(lines, id, "ERROR") && ok;
+    ok = checkReply(lines, "f", "OK") && ok;
+    if (readFile((outside / "victim.png").string()) != "victim" ||
+        readFile((outside / "victim_ridge.txt").string()) != "victim") {
+        cout << "WRONG ANSWER: a file outside the root was overwritten" << endl;
+        ok = false;
+    }
+    if (filesystem::exists(outside / "made_ridge.txt")) {
+        cout << "WRONG ANSWER: a file outside the root was made" << endl;
+        ok = false;
+    }
+    if (readFile((root / "out_ridge.txt").string()) != sections["f"]["ridge"]) {
+        cout << "WRONG ANSWER: written and sent ridge points differ" << endl;
+        ok = false;
+    }
+
+    // with no root, the same paths are allowed
+    lines = replyLines(serve("e ridge " + (root / "link.png").string() + "\n"), sections);
+    ok = checkReply(lines, "e", "OK") && ok;
+
+    // a line of 16 KiB, newline included, is served; a longer one ends the
+    // requests, as the rest of it cannot be told from the next request
+    string request = "j ridge " + (root / "in.png").string();
+    string longest = request + string(16383 - request.size(), ' ') + "\n";
+    string tooLong = "k ridge " + string(16 << 10, 'a') + "\n";
+    lines = replyLines(serve(longest + tooLong + "l ridge in.png\n"), sections);
+    ok = checkReply(lines, "j", "OK") && ok;
+    ok = checkReply(lines, "k", "ERROR") && ok;
+    if (lines.count("l") || lines.count("aaaa")) {
+        cout << "WRONG ANSWER: requests after a line that is too long were read" << endl;
+        ok = false;
+    }
+    lines = replyLines(serve(string(20000, ' ') + "\n"), sections);
+    ok = checkReply(lines, "-", "ERROR") && ok;
+
+    // inline data is framed by its size, and the outputs sent back are the
+    // same as the ones written to files
+    string png = readFile("../images/rectangle.png");
+    string inlined = "inline:" + to_string(png.size()) + "\n" + png;
+    lines = replyLines(serve("m recreated,ridge,distance in.png made\n"
+                             "n recreated,ridge,distance " + inlined +
+                             "o ridge " + inlined +
+                             "p ridge,bogus in.png\n"
+                             "q ridge\n"
+                             "r ridge inline:12x\n"
+                             "s ridge inline:\n"
+                             "t ridge inline:268435457\n"
+                             "u ridge in.png\n", root.string()), sections);
+    ok = checkReply(lines, "m", "OK") && ok;
+    ok = checkReply(lines, "n", "OK") && ok;
+    ok = checkReply(lines, "o", "OK") && ok;
+    for (string id : {"p", "q", "r", "s", "t"})
+        ok = checkReply(lines, id, "ERROR") && ok;
+    if (lines.count("u")) {
+        cout << "WRONG ANSWER: requests after oversized inline data were read" << endl;
+        ok = false;
+    }
+    map<string, string> & sent = sections["n"];
+    PNG recreated;
+    if (lines["n"] != "OK n 3" || sections["o"].size() != 1 ||
+        sent["recreated"] != readFile((root / "made.png").string()) ||
+        sent["ridge"] != readFile((root / "made_ridge.txt").string()) ||
+        sent["distance"] != readFile((root / "made_distance.txt").string()) ||
+        sections["o"]["ridge"] != sent["ridge"] ||
+        !recreated.read((const unsigned char *)sent["recreated"].data(),
+                        sent["recreated"].size())) {
+        cout << "WRONG ANSWER: inline outputs differ from the written ones" << endl;
+        ok = false;
+    }
+
+    // data that stops short of its size
+    lines = replyLines(serve("v ridge inline:" + to_string(png.size()) + "\n" +
+                             png.substr(0, 10)), sections);
+    ok = checkReply(lines, "v", "ERROR") && ok;
+
+    filesystem::remove_all(directory);
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+/*
+    Runs a batch of the images in ../images, and one input that does not
+    exist, writing every output.
+
+    @param directory Where the outputs go
+    @param options The settings of the batch; every output is emitted
+    @return the jobs of the batch
+*/
+vector<BatchJob> runImages(const filesystem::path & directory, BatchOptions options) {
+    vector<string> inputs;
+    for (const filesystem::directory_entry & entry : filesystem::directory_iterator("../images"))
+        inputs.push_back(entry.path().string());
+    sort(inputs.begin(), inputs.end());
+    inputs.push_back("../images/missing.png");
+
+    vector<BatchJob> jobs;
+    for (const string & input : inputs) {
+        BatchJob job;
+        job.input = input;
+        job.output = (directory / filesystem::path(input).stem()).string();
+        jobs.push_back(job);
+    }
+    filesystem::create_directories(directory);
+    options.emit = EMIT_RECREATED | EMIT_RIDGE | EMIT_DISTANCE;
+    runBatch(jobs, options);
+    return jobs;
+}
+
+/*
+    Checks that two batches of the same images had the same results and
+    wrote the same bytes.
+
+    @param name The name of the second batch, for reporting
+    @param expected The jobs of the first batch
+    @param jobs The jobs of the second batch
+*/
+bool sameBatch(const string & name, const vector<BatchJob> & expected,
+               const vector<BatchJob> & jobs) {
+    bool ok = expected.size() == jobs.size();
+    for (size_t i = 0; ok && i < jobs.size(); i++) {
+        ok = jobs[i].ok == expected[i].ok && jobs[i].error == expected[i].error;
+        for (string suffix : {".png", "_ridge.txt", "_distance.txt"}) {
+            if (!ok || !jobs[i].ok) break;
+            string data = readFile(jobs[i].output + suffix);
+            ok = !data.empty() && data == readFile(expected[i].output + suffix);
+        }
+        if (!ok) cout << "WRONG ANSWER: " << name << " differs on " << jobs[i].input << endl;
+    }
+    return ok;
+}
+
+/*
+    Checks that a bounded queue keeps the order of each producer, holds no
+    more than its capacity, and ends once every producer is done.
+*/
+bool checkQueue() {
+    const int count = 10000;
+    BoundedQueue<pair<int, int>> queue(3, 2);
+    vector<thread> producers;
+    for (int p = 0; p < 2; p++) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < count; i++) queue.push(make_pair(p, i));
+            queue.producerDone();
+        });
+    }
+    int next[2] = {0, 0};
+    bool ok = true;
+    pair<int, int> item;
+    while (queue.pop(item)) {
+        ok = ok && item.second == next[item.first];
+        next[item.first]++;
+    }
+    for (thread & producer : producers) producer.join();
+    ok = ok && next[0] == count && next[1] == count && !queue.pop(item);
+    if (!ok) cout << "WRONG ANSWER: the queue lost or reordered items" << endl;
+
+    // a producer waits while the queue is full
+    BoundedQueue<int> full(2, 1);
+    atomic<int> pushed(0);
+    thread producer([&]() {
+        for (int i = 0; i < 3; i++) {
+            full.push(int(i));
+            pushed++;
+        }
+        full.producerDone();
+    });
+    this_thread::sleep_for(chrono::milliseconds(50));
+    bool held = pushed == 2;
+    int value = -1;
+    for (int i = 0; held && i < 3; i++) held = full.pop(value) && value == i;
+    producer.join();
+    held = held && !full.pop(value);
+    if (!held) cout << "WRONG ANSWER: the queue went over its capacity" << endl;
+    return ok && held;
+}
+
+/*
+    Checks that the ways of running a batch give the same outputs as one
+    worker does: the pool of workers, the pipeline of decode, compute and
+    encode stages, and the cache when it is cold and when it is warm.
+*/
+int testBatch() {
+    filesystem::path directory = filesystem::temp_directory_path() /
+                                 ("skeleton_batch_test_" + to_string(getpid()));
+    filesystem::remove_all(directory);
+    bool ok = true;
+    for (metric distance_metric : {MANHATTAN, EUCLIDEAN}) {
+        BatchOptions options;
+        options.distance_metric = distance_metric;
+        vector<BatchJob> expected = runImages(directory / "one", options);
+        if (expected.back().ok || !expected.front().ok) {
+            cout << "WRONG ANSWER: the batch did not report which images failed" << endl;
+            ok = false;
+        }
+
+        options.threads = 3;
+        ok = sameBatch("the pool", expected, runImages(directory / "pool", options)) && ok;
+        options.transform_threads = 4;
+        ok = sameBatch("split transforms", expected, runImages(directory / "split", options)) && ok;
+        options.transform_threads = 1;
+
+        // one of each stage, then more decoders and encoders than workers
+        // with room for one image between stages
+        options.threads = 1;
+        options.decode_threads = 1;
+        options.encode_threads = 1;
+        ok = sameBatch("the pipeline", expected, runImages(directory / "pipeline", options)) && ok;
+        options.threads = 2;
+        options.decode_threads = 3;
+        options.encode_threads = 3;
+        options.queue_size = 1;
+        ok = sameBatch("the wide pipeline", expected,
+                       runImages(directory / "wide", options)) && ok;
+        options = BatchOptions();
+        options.distance_metric = distance_metric;
+        options.threads = 3;
+
+        ResultCache cache((directory / "cache").string());
+        options.cache = &cache;
+        ok = sameBatch("a cold cache", expected, runImages(directory / "cold", options)) && ok;
+        size_t stored = 0;
+        for (auto & entry : filesystem::recursive_directory_iterator(directory / "cache"))
+            stored += entry.is_regular_file();
+        if (stored != expected.size() - 1) {
+            cout << "WRONG ANSWER: the cache holds " << stored << " results" << endl;
+            ok = false;
+        }
+        ok = sameBatch("a warm cache", expected, runImages(directory / "warm", options)) && ok;
+        filesystem::remove_all(directory);
+    }
+    ok = checkQueue() && ok;
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+/*
+    Checks the jobs made from a manifest or a directory against the inputs
+    and outputs they should have.
+*/
+bool checkJobs(const string & name, const vector<BatchJob> & jobs,
+               const vector<pair<string, string>> & expected) {
+    bool ok = jobs.size() == expected.size();
+    for (size_t i = 0; ok && i < jobs.size(); i++)
+        ok = jobs[i].input == expected[i].first && jobs[i].output == expected[i].second;
+    if (!ok) cout << "WRONG ANSWER: the jobs of " << name << endl;
+    return ok;
+}
+
+/*
+    Checks the parsing of command line values, manifests and input
+    directories.
+*/
+int testParse() {
+    bool ok = true;
+    int emit = 0;
+    ok = ok && parseEmit("recreated", emit) && emit == EMIT_RECREATED;
+    ok = ok && parseEmit("ridge,distance", emit) && emit == (EMIT_RIDGE | EMIT_DISTANCE);
+    ok = ok && parseEmit("distance,recreated,ridge", emit) && emit == 7;
+    for (string list : {"", "bogus", "ridge,bogus", ",ridge", "Ridge"})
+        ok = ok && !parseEmit(list, emit);
+    if (!ok) cout << "WRONG ANSWER: parseEmit" << endl;
+
+    int count = -1;
+    bool counts = parseCount("4", 1, count) && count == 4;
+    counts = counts && parseCount("0", 0, count) && count == 0;
+    counts = counts && parseCount("2147483647", 1, count) && count == 2147483647;
+    for (const char * text : {"0", "-1", "", "3x", "x3", "2147483648", "99999999999999999999"})
+        counts = counts && !parseCount(text, 1, count);
+    if (!counts) cout << "WRONG ANSWER: parseCount" << endl;
+    ok = ok && counts;
+
+    filesystem::path directory = filesystem::temp_directory_path() /
+                                 ("skeleton_parse_test_" + to_string(getpid()));
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory / "images" / "sub.png");
+    for (string file : {"z.png", "a.png", "notes.txt", "b.PNG"})
+        writeFile((directory / "images" / file).string(), "");
+
+    // comments and blank lines are skipped, a .png on an output is
+    // dropped, and inputs without an output go to the output directory
+    string manifest = (directory / "manifest").string();
+    writeFile(manifest, "# a comment\n"
+                        "\n"
+                        "  a.png\n"
+                        "b.png out/b.png\n"
+                        "\tc.png   out/c  \n"
+                        "d.png out/d.txt extra\n"
+                        "   #e.png\n"
+                        "f.png");
+    vector<BatchJob> jobs;
+    ok = addManifest(jobs, manifest, "outdir") && ok;
+    ok = checkJobs("the manifest", jobs, {{"a.png", "outdir/a"}, {"b.png", "out/b"},
+                                          {"c.png", "out/c"}, {"d.png", "out/d.txt"},
+                                          {"f.png", "outdir/f"}}) && ok;
+    jobs.clear();
+    if (addManifest(jobs, (directory / "missing").string(), "outdir") || !jobs.empty()) {
+        cout << "WRONG ANSWER: a missing manifest was read" << endl;
+        ok = false;
+    }
+
+    // only the png files of a directory, in name order
+    string images = (directory / "images").string();
+    ok = addDirectory(jobs, images, "outdir") && ok;
+    ok = checkJobs("the directory", jobs, {{images + "/a.png", "outdir/a"},
+                                           {images + "/z.png", "outdir/z"}}) && ok;
+    if (addDirectory(jobs, (directory / "missing").string(), "outdir")) {
+        cout << "WRONG ANSWER: a missing directory was read" << endl;
+        ok = false;
+    }
+
+    filesystem::remove_all(directory);
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+// while counting, the number and size of allocations made with operator new
+static bool countAllocations = false;
+static long long allocations = 0;
+static size_t allocatedBytes = 0;
+
+void * operator new(size_t size) {
+    if (countAllocations) {
+        allocations++;
+        allocatedBytes += size;
+    }
+    void * memory = malloc(size ? size : 1);
+    if (!memory) throw bad_alloc();
+    return memory;
+}
+
+// kept out of line, or GCC warns of free on memory from new where it is
+// inlined
+__attribute__((noinline)) void operator delete(void * memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void * memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+/*
+    Returns every output of a skeleton as text: the recreated image, the
+    ridge points, the distance map and the segment count.
+*/
+string describe(Skeleton & skeleton) {
+    const PNG & recreated = skeleton.getRecreatedImage();
+    SkeletonOutputs outputs = outputsOf(&recreated, &skeleton.getRidgePointList(),
+                                        &skeleton.getDistanceMap());
+    ostringstream text;
+    text << skeleton.getSegmentCount() << "\n";
+    printRidgePoints(text, outputs);
+    printDistanceMap(text, outputs);
+    text.write((const char *)recreated.getRawData(),
+               (size_t)recreated.getWidth() * recreated.getHeight() * 4);
+    return text.str();
+}
+
+/*
+    Skeletonizes an image through a workspace and hands the buffers back.
+
+    @param image The image
+    @param options The settings, with the workspace
+    @param text Set to the outputs, as by describe
+    @return the allocations made, other than by describe
+*/
+long long skeletonizeInto(const PNG & image, const SkeletonOptions & options, string & text) {
+    allocations = 0;
+    countAllocations = true;
+    Skeleton skeleton(image, options);
+    skeleton.getRecreatedImage();
+    skeleton.getSegmentCount();
+    countAllocations = false;
+    long long made = allocations;
+    text = describe(skeleton);
+
+    allocations = 0;
+    countAllocations = true;
+    skeleton.recycleInto(*options.workspace);
+    countAllocations = false;
+    return made + allocations;
+}
+
+/*
+    Checks that a skeleton calculated in a warm workspace is the same as one
+    calculated from nothing, and that at one thread, images the workspace
+    has already seen are skeletonized without allocating. More threads
+    allocate as they are started.
+*/
+int testWorkspace() {
+    bool ok = true;
+    for (metric distance_metric : {MANHATTAN, EUCLIDEAN}) {
+        for (int threads : {1, 3}) {
+            SkeletonWorkspace workspace;
+            SkeletonOptions options;
+            options.distance_metric = distance_metric;
+            options.threads = threads;
+            options.workspace = &workspace;
+
+            // a large image then smaller ones, whose distance maps may
+            // need other cell widths, twice over
+            vector<string> names = {"hansolo", "rose", "rectangle_border_noise"};
+            for (size_t i = 0; i < 2 * names.size(); i++) {
+                const string & name = names[i % names.size()];
+                PNG image(("../images/" + name + ".png").c_str());
+                string text;
+                long long made = skeletonizeInto(image, options, text);
+
+                SkeletonOptions fresh;
+                fresh.distance_metric = distance_metric;
+                Skeleton expected(image, fresh);
+                if (text != describe(expected)) {
+                    cout << "WRONG ANSWER: " << name << " differs through a workspace" << endl;
+                    ok = false;
+                }
+                if (threads == 1 && i >= names.size() && made != 0) {
+                    cout << "WRONG ANSWER: " << name << " made " << made
+                         << " allocations in a warm workspace" << endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+// a mask drawn with # for its 1s, and the ridge points found in it
+struct RidgeCase {
+    const char * name;
+    // each row is the mask, then the prominency of each ridge point under
+    // the Manhattan and the Euclidean metric (0 for none, then weak, good
+    // and strong)
+    vector<string> rows;
+};
+
+// the ridge points of these were found by the second pass as it was when it
+// rescanned every pixel for endpoints; the 1s are the branches it added
+static const RidgeCase ridgeCases[] = {
+    {"plus", {
+        "....###....  00002120000  00002120000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "###########  21000300000  21000300000",
+        "###########  03333333331  03333333331",
+        "###########  21000300011  21000300011",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000310000  00000310000",
+        "....###....  00000110000  00000110000"
+    }},
+    {"L", {
+        "###.......  2120000000  2120000000",
+        "###.......  0300000000  0300000000",
+        "###.......  0300000000  0300000000",
+        "###.......  0300000000  0300000000",
+        "###.......  0300000000  0300000000",
+        "###.......  0300000000  0300000000",
+        "##########  0030000000  0300000000",
+        "##########  0233333331  0233333331",
+        "##########  0000000011  0000000011"
+    }},
+    {"dumbbell", {
+        "..............  00000000000000  00000000000000",
+        ".####....####.  02112000020120  02112000020120",
+        ".####....####.  00230000001300  00230000001300",
+        ".############.  00033333333000  00033333333000",
+        ".####....####.  00230000001300  00230000001300",
+        ".####....####.  02112000020120  02112000020120",
+        "..............  00000000000000  00000000000000"
+    }},
+    {"ring", {
+        "##########  2100000000  2100000000",
+        "##########  0333333331  0333333331",
+        "##......##  0300000011  0300000011",
+        "##......##  0300000000  0300000000",
+        "##......##  0300000000  0300000000",
+        "##......##  0300000000  0300000000",
+        "##......##  0300000000  0300000000",
+        "##......##  0300000000  0300000000",
+        "##########  0311111131  0311111131",
+        "##########  0000000011  0000000011"
+    }},
+    {"T", {
+        "###########  21000000000  21000000000",
+        "###########  03330003331  03333033331",
+        "###########  21003330011  21000300011",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000310000  00000310000",
+        "....###....  00000110000  00000110000"
+    }},
+    {"blob", {
+        "....#######...  00000000000000  00000000000000",
+        "..##########..  01100000000000  00000000000000",
+        ".############.  00202333333000  00002333333000",
+        ".############.  00023000003000  00033000003000",
+        ".#####...####.  00030000000300  00330000000300",
+        ".####.....###.  00230000000300  00030000000300",
+        "..###.....##..  00030000001300  00030000001300",
+        "...##.....#...  00013000003000  00013000003000",
+        "..............  00000000000000  00000000000000"
+    }}
+};
+
+// a hash of the ridge points of 60 random masks under each metric, as
+// given by the full rescan (see ridgeHash)
+static const unsigned long long ridgeHashes[] = {
+    18118449902135990429ULL, 12692565785632148424ULL
+};
+
+/*
+    Returns the image drawn in the masks of a ridge case.
+*/
+vector<vector<int>> maskImage(const RidgeCase & ridgeCase) {
+    vector<vector<int>> image;
+    for (const string & row : ridgeCase.rows) {
+        image.push_back(vector<int>());
+        for (size_t x = 0; row[x] != ' '; x++) image.back().push_back(row[x] == '#');
+    }
+    return image;
+}
+
+/*
+    Returns the ridge points of a skeleton drawn as in a ridge case.
+*/
+vector<string> ridgeRows(Skeleton & skeleton) {
+    const Grid<int> & ridge_points = skeleton.getRidgePoints();
+    vector<string> rows;
+    for (int y = 0; y < ridge_points.getHeight(); y++) {
+        rows.push_back("");
+        for (int x = 0; x < ridge_points.getWidth(); x++)
+            rows.back() += (char)('0' + ridge_points[y][x]);
+    }
+    return rows;
+}
+
+/*
+    Returns a hash of the ridge points of 60 random masks of up to 47 x 47
+    pixels.
+*/
+unsigned long long ridgeHash(metric distance_metric) {
+    unsigned long long hash = 1469598103934665603ULL;
+    srand(7);
+    for (int i = 0; i < 60; i++) {
+        int width = 8 + rand() % 40;
+        int height = 8 + rand() % 40;
+        int density = 50 + rand() % 45;
+        vector<vector<int>> image(height, vector<int>(width));
+        for (vector<int> & row : image) {
+            for (int & pixel : row) pixel = rand() % 100 < density;
+        }
+        SkeletonOptions options;
+        options.distance_metric = distance_metric;
+        Skeleton skeleton(image, options);
+        const Grid<int> & ridge_points = skeleton.getRidgePoints();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                hash ^= (unsigned)ridge_points[y][x] + 1;
+                hash *= 1099511628211ULL;
+            }
+        }
+    }
+    return hash;
+}
+
+/*
+    Checks the ridge points of small masks against the ones the second pass
+    found when it rescanned every pixel, rather than working from the
+    endpoints of the first.
 */
-int main() {
+bool checkRidgePoints() {
+    bool ok = true;
+    for (const RidgeCase & ridgeCase : ridgeCases) {
+        vector<vector<int>> image = maskImage(ridgeCase);
+        for (metric distance_metric : {MANHATTAN, EUCLIDEAN}) {
+            SkeletonOptions options;
+            options.distance_metric = distance_metric;
+            Skeleton skeleton(image, options);
+            vector<string> rows = ridgeRows(skeleton);
+            int column = distance_metric == MANHATTAN ? 1 : 2;
+            for (size_t y = 0; y < rows.size(); y++) {
+                istringstream fields(ridgeCase.rows[y]);
+                string expected[3];
+                fields >> expected[0] >> expected[1] >> expected[2];
+                if (rows[y] == expected[column]) continue;
+                cout << "WRONG ANSWER: " << ridgeCase.name << " row " << y << " has ridge points "
+                     << rows[y] << " where should be " << expected[column] << endl;
+                ok = false;
+                break;
+            }
+        }
+    }
+    for (metric distance_metric : {MANHATTAN, EUCLIDEAN}) {
+        if (ridgeHash(distance_metric) != ridgeHashes[distance_metric]) {
+            cout << "WRONG ANSWER: the ridge points of the random masks changed" << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// a mask, and its skeleton and segment count under the Manhattan metric
+// without and with stop_when_connected
+struct SegmentCase {
+    const char * name;
+    int segments[2];
+    // each row is the mask, then the ridge points without and with the
+    // option, drawn as in a RidgeCase
+    vector<string> rows;
+};
+
+static const SegmentCase segmentCases[] = {
+    // the first pass is in one piece, so no branch is added with the option
+    {"plus", {1, 1}, {
+        "....###....  00002120000  00002020000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "###########  21000300000  20000300000",
+        "###########  03333333331  03333333330",
+        "###########  21000300011  20000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000300000  00000300000",
+        "....###....  00000310000  00000300000",
+        "....###....  00000110000  00000000000"
+    }},
+    // two pieces that no branch can link
+    {"apart", {2, 2}, {
+        "..........  0000000000  0000000000",
+        ".###..###.  0212002120  0202002020",
+        ".###..###.  0030000300  0030000300",
+        ".###..###.  0212002120  0202002020",
+        "..........  0000000000  0000000000"
+    }},
+    // the first pass leaves three pieces, linked by fewer branch points
+    // with the option
+    {"linked", {1, 1}, {
+        "#########  230311000  230311000",
+        "#.#.#####  303003020  303003020",
+        ".########  003030330  003030330",
+        "#####.###  003100030  003000030",
+        "#########  031300330  030300330",
+        "####.####  000000000  000000000"
+    }}
+};
+
+/*
+    Returns the number of 8-connected pieces of a skeleton, counting only
+    the points of the first pass if strong is set.
+*/
+int countPieces(Skeleton & skeleton, bool strong = false) {
+    const Grid<int> & ridge_points = skeleton.getRidgePoints();
+    int width = ridge_points.getWidth();
+    int height = ridge_points.getHeight();
+    auto on = [&](int x, int y) {
+        return x >= 0 && y >= 0 && x < width && y < height &&
+               ridge_points[y][x] != NONE && (!strong || ridge_points[y][x] != WEAK);
+    };
+    vector<vector<bool>> seen(height, vector<bool>(width, false));
+    int pieces = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!on(x, y) || seen[y][x]) continue;
+            pieces++;
+            vector<pair<int,int>> stack = {{x, y}};
+            seen[y][x] = true;
+            while (!stack.empty()) {
+                pair<int,int> p = stack.back();
+                stack.pop_back();
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = p.first + dx;
+                        int ny = p.second + dy;
+                        if (!on(nx, ny) || seen[ny][nx]) continue;
+                        seen[ny][nx] = true;
+                        stack.push_back({nx, ny});
+                    }
+                }
+            }
+        }
+    }
+    return pieces;
+}
+
+/*
+    Checks the union-find that segments are counted with.
+*/
+bool checkDisjointSet() {
+    DisjointSet set;
+    for (int i = 0; i < 6; i++) set.add();
+    bool ok = set.count() == 6;
+    ok = ok && set.unite(0, 1) && set.unite(2, 3) && set.unite(1, 3) && set.count() == 3;
+    ok = ok && !set.unite(0, 2) && set.count() == 3;
+    ok = ok && set.find(0) == set.find(3) && set.find(4) != set.find(5) &&
+         set.find(4) != set.find(0);
+    set.clear();
+    ok = ok && set.count() == 0 && set.add() == 0 && set.count() == 1;
+    if (!ok) cout << "WRONG ANSWER: DisjointSet" << endl;
+    return ok;
+}
+
+/*
+    Checks getSegmentCount against the pieces of the skeleton, with and
+    without stop_when_connected, and that the option keeps the points of the
+    first pass and adds no branch when they are already in one piece.
+*/
+bool checkSegments() {
+    bool ok = checkDisjointSet();
+    for (const SegmentCase & segmentCase : segmentCases) {
+        vector<vector<int>> image;
+        vector<string> expected[2];
+        for (const string & row : segmentCase.rows) {
+            istringstream fields(row);
+            string mask;
+            fields >> mask >> expected[0].emplace_back() >> expected[1].emplace_back();
+            image.push_back(vector<int>());
+            for (char pixel : mask) image.back().push_back(pixel == '#');
+        }
+        for (int stop : {0, 1}) {
+            SkeletonOptions options;
+            options.stop_when_connected = stop;
+            Skeleton skeleton(image, options);
+            if (ridgeRows(skeleton) != expected[stop] ||
+                skeleton.getSegmentCount() != segmentCase.segments[stop]) {
+                cout << "WRONG ANSWER: the segments of " << segmentCase.name
+                     << (stop ? " with" : " without") << " stop_when_connected" << endl;
+                ok = false;
+            }
+        }
+    }
+
+    srand(11);
+    for (int i = 0; i < 200; i++) {
+        int width = 8 + rand() % 40;
+        int height = 8 + rand() % 40;
+        int density = 50 + rand() % 45;
+        vector<vector<int>> image(height, vector<int>(width));
+        for (vector<int> & row : image) {
+            for (int & pixel : row) pixel = rand() % 100 < density;
+        }
+        for (metric distance_metric : {MANHATTAN, EUCLIDEAN}) {
+            SkeletonOptions options;
+            options.distance_metric = distance_metric;
+            Skeleton all(image, options);
+            options.stop_when_connected = true;
+            Skeleton linking(image, options);
+            const Grid<int> & allPoints = all.getRidgePoints();
+            const Grid<int> & linkingPoints = linking.getRidgePoints();
+            bool sameFirstPass = true;
+            int branchPoints = 0;
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    sameFirstPass = sameFirstPass &&
+                        (allPoints[y][x] > WEAK) == (linkingPoints[y][x] > WEAK);
+                    branchPoints += linkingPoints[y][x] == WEAK;
+                }
+            }
+            if (all.getSegmentCount() != countPieces(all) ||
+                linking.getSegmentCount() != countPieces(linking) || !sameFirstPass ||
+                (countPieces(linking, true) <= 1 && branchPoints)) {
+                cout << "WRONG ANSWER: the segments of random mask " << i << endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+/*
+    Returns a distance map or a list of ridge points as the batch prints it.
+*/
+string outputText(const DistanceMap * distance_map, const vector<RidgePoint> * ridge_list) {
+    ostringstream text;
+    SkeletonOutputs outputs = outputsOf(NULL, ridge_list, distance_map);
+    if (distance_map) printDistanceMap(text, outputs);
+    if (ridge_list) printRidgePoints(text, outputs);
+    return text.str();
+}
+
+/*
+    Checks that the getters return the skeleton's own results rather than
+    copies, and that the take functions move them out without copying.
+*/
+bool checkTakes() {
+    PNG image("../images/rose.png");
+    Skeleton expected(image);
+    string distanceText = outputText(&expected.getDistanceMap(), NULL);
+    string ridgeText = outputText(NULL, &expected.getRidgePointList());
+    const PNG & expectedImage = expected.getRecreatedImage();
+    size_t imageBytes = (size_t)expectedImage.getWidth() * expectedImage.getHeight() * 4;
+
+    Skeleton skeleton(image);
+    bool ok = &skeleton.getDistanceMap() == &skeleton.getDistanceMap() &&
+              &skeleton.getRidgePoints() == &skeleton.getRidgePoints() &&
+              &skeleton.getRidgePointList() == &skeleton.getRidgePointList() &&
+              &skeleton.getRecreatedImage() == &skeleton.getRecreatedImage();
+
+    const void * cells = skeleton.getDistanceMap().rowData(0);
+    const int * points = skeleton.getRidgePoints()[0];
+    const RidgePoint * list = skeleton.getRidgePointList().data();
+    const unsigned char * pixels = skeleton.getRecreatedImage().getRawData();
+    DistanceMap distance_map = skeleton.takeDistanceMap();
+    Grid<int> ridge_points = skeleton.takeRidgePoints();
+    vector<RidgePoint> ridge_list = skeleton.takeRidgePointList();
+    PNG recreated = skeleton.takeRecreatedImage();
+    ok = ok && distance_map.rowData(0) == cells && ridge_points[0] == points &&
+         ridge_list.data() == list && recreated.getRawData() == pixels;
+    ok = ok && outputText(&distance_map, NULL) == distanceText &&
+         outputText(NULL, &ridge_list) == ridgeText &&
+         memcmp(recreated.getRawData(), expectedImage.getRawData(), imageBytes) == 0;
+    const Grid<int> & expectedPoints = expected.getRidgePoints();
+    for (int y = 0; ok && y < (int)image.getHeight(); y++) {
+        ok = memcmp(ridge_points[y], expectedPoints[y], image.getWidth() * sizeof(int)) == 0;
+    }
+    if (!ok) cout << "WRONG ANSWER: the results were copied out of the skeleton" << endl;
+    return ok;
+}
+
+/*
+    Returns the bytes allocated by a call.
+*/
+template <typename F>
+size_t bytesAllocated(F f) {
+    allocatedBytes = 0;
+    countAllocations = true;
+    f();
+    countAllocations = false;
+    return allocatedBytes;
+}
+
+/*
+    Checks that each output is calculated the first time it is asked for,
+    and once only, and that one taken out of a skeleton is calculated again
+    when it is asked for, without calculating again the ones still there.
+*/
+bool checkLazy() {
+    PNG image("../images/rose.png");
+    size_t imageBytes = (size_t)image.getWidth() * image.getHeight() * 4;
+    Skeleton fresh(image);
+    string expected = describe(fresh);
+
+    Skeleton skeleton(image);
+    bool ok = bytesAllocated([&]() { skeleton.getDistanceMap(); }) > 0;
+    ok = ok && bytesAllocated([&]() { skeleton.getDistanceMap(); }) == 0;
+    ok = ok && bytesAllocated([&]() { skeleton.getRidgePointList(); }) > 0;
+    ok = ok && bytesAllocated([&]() { skeleton.getSegmentCount(); }) == 0;
+    ok = ok && bytesAllocated([&]() { skeleton.getRecreatedImage(); }) >= imageBytes;
+    ok = ok && bytesAllocated([&]() { skeleton.getRecreatedImage();
+                                      skeleton.getRidgePoints(); }) == 0;
+    if (!ok) cout << "WRONG ANSWER: outputs were not calculated on first access" << endl;
+
+    // each take, then the rest asked for: only what was taken is calculated
+    // again, and the results are the same
+    for (int taken = 0; taken < 4; taken++) {
+        Skeleton skeleton(image);
+        describe(skeleton);
+        size_t again;
+        if (taken == 0) {
+            skeleton.takeDistanceMap();
+            again = bytesAllocated([&]() { skeleton.getRecreatedImage();
+                                          skeleton.getRidgePointList(); });
+        } else if (taken == 1) {
+            skeleton.takeRidgePoints();
+            again = bytesAllocated([&]() { skeleton.getRidgePointList();
+                                          skeleton.getSegmentCount(); });
+        } else if (taken == 2) {
+            skeleton.takeRidgePointList();
+            again = bytesAllocated([&]() { skeleton.getRidgePoints();
+                                          skeleton.getSegmentCount(); });
+        } else {
+            skeleton.takeRecreatedImage();
+            again = bytesAllocated([&]() { skeleton.getDistanceMap();
+                                          skeleton.getRidgePointList(); });
+        }
+        if (again != 0 || describe(skeleton) != expected) {
+            cout << "WRONG ANSWER: take " << taken << " calculated the wrong outputs" << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/*
+    Checks the skeletons of small hand-made masks, and how and when their
+    outputs are calculated and handed out.
+*/
+int testSkeleton() {
+    bool ok = checkRidgePoints();
+    ok = checkSegments() && ok;
+    ok = checkTakes() && ok;
+    ok = checkLazy() && ok;
+    if (!ok) return 1;
+    cout << "CORRECT" << endl;
+    return 0;
+}
+
+/*
+    Driver for taking in test cases and verifying the output. With an
+    argument, runs the self-checking tests of that name instead:
+    distance, cache, server, batch, parse, workspace or skeleton.
+*/
+int main(int argc, char ** argv) {
     ios_base::sync_with_stdio(0); cin.tie(0);
 
+    if (argc > 1) {
+        string mode = argv[1];
+        if (mode == "distance") return testDistance();
+        if (mode == "cache") return testCache();
+        if (mode == "server") return testServer();
+        if (mode == "batch") return testBatch();
+        if (mode == "parse") return testParse();
+        if (mode == "workspace") return testWorkspace();
+        if (mode == "skeleton") return testSkeleton();
+        cout << "unknown test " << mode << endl;
+        return 1;
+    }
+
     solveProblem();
 
-    PNG recreated = skeleton.getRecreatedImage();
+    const PNG & recreated = skeleton.getRecreatedImage();
+    const DistanceMap & distance_map = skeleton.getDistanceMap();
 
     // verifying the produced image
     for (int y = 0; y < img.size(); y++) {
@@ -71,7 +1572,7 @@ int main() {
                 return 0;
             }
             if (img[y][x] && recreated.getPixel(x, y) == WHITEPIXEL &&
-                skeleton.getDistanceMap()[y][x] != 1) {
+                distance_map[y][x] != 1) {
                 cout << "WRONG ANSWER: 0 at (" << x << "," << y << ") where should be 1" << endl;
             }
         }